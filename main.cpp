@@ -28,667 +28,5117 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <tuple>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 /**
- * \brief \c risc_v_assembler is a class that allows for the assembly of RISC-V into a file.
- * \note If you would like a binary executable, edit the fprintf statement in the \c process() function.
+ * \brief \c diagnostic holds one error found while assembling.
  */
-class risc_v_assembler {
-	protected:
-		/**
-		 * \brief \c input_file holds the name of the input file.
-		 */
-		char * input_file = nullptr;
-		/**
-		 * \brief \c output_file holds the name of the output file.
-		 */
-		char * output_file = nullptr;
-		/**
-		 * \brief \c labels holds the locations of all of the labels in the file by the location of the next instruction.
-		 */
-		map <string, uint64_t> labels;
-		
-		
-		
-		uint32_t getRegister(string, uint8_t);
-		uint32_t getOpcode(string, char&);
-		void makeLabel(string, uint64_t);
-		uint64_t findLabelPos(string);
-		uint32_t processLine(string, uint64_t);
+struct diagnostic {
+	/**
+	 * \brief \c line is the source line the error was found on, starting at 1.
+	 */
+	uint64_t line;
+	/**
+	 * \brief \c column is the column of the offending token, starting at 1.
+	 */
+	uint64_t column;
+	/**
+	 * \brief \c message describes the error.
+	 */
+	string message;
+};
+
+/**
+ * \brief \c assembly_error is thrown to abandon the line that is being assembled.
+ * \details It is caught in \c process(), which records a \c diagnostic and carries on with the next line.
+ */
+class assembly_error : public runtime_error {
 	public:
-		/**
-		 * \brief Default constructor.
-		 */
-		risc_v_assembler() {}
-		/**
-		 * \brief Constructor with file names.
-		 * 
-		 * \param [in] input_file_name is the name of the input file.
-		 * \param [in] output_file_name is the name of the output file.
-		 */
-		risc_v_assembler(char * input_file_name, char * output_file_name) {
-			input_file = input_file_name;
-			output_file = output_file_name;
-		}
-		
-		void process();
-		char * getInputFile();
-		char * getOutputFile();
-		void setInputFile(char * );
-		void setOutputFile(char * );
-		
+		using runtime_error::runtime_error;
 };
 
 /**
- * \brief \c getRegister() is a function that interprets strings and gives the corresponding register out.
+ * \brief \c signedMin() gives the smallest value of a signed immediate field.
  * 
- * \param [in] input is a string to be interpreted as a register.
- * \param [in] offset is the logical shift left amount for the output. 
- * \return the register number 0-31
+ * \param [in] bits is the width of the field.
+ * \returns -2^(bits-1)
  */
-uint32_t risc_v_assembler::getRegister(string input, uint8_t offset = 0) {
-	uint32_t numeric_part = 0;
-	string non_numeric_part = "";
-	
-	if (input.size() > 4) {
-		cerr << "ERROR: invalid input in register name.\n";
-		abort();
+constexpr int64_t signedMin(unsigned bits) {
+	return -(INT64_C(1) << (bits - 1));
+}
+
+/**
+ * \brief \c signedMax() gives the largest value of a signed immediate field.
+ * 
+ * \param [in] bits is the width of the field.
+ * \returns 2^(bits-1) - 1
+ */
+constexpr int64_t signedMax(unsigned bits) {
+	return (INT64_C(1) << (bits - 1)) - 1;
+}
+
+/**
+ * \brief \c signExtend() sign extends the low bits of a value.
+ * 
+ * \param [in] value is the value, only its low \c bits are used.
+ * \param [in] bits is the width of the value, 1 to 64.
+ * \returns The value as a 64 bit signed number.
+ */
+constexpr int64_t signExtend(int64_t value, unsigned bits) {
+	return (int64_t)((uint64_t)value << (64 - bits)) >> (64 - bits);
+}
+
+/**
+ * \brief \c bit_field describes one slice of an immediate and where it sits in an instruction.
+ */
+struct bit_field {
+	/**
+	 * \brief \c imm_lsb is the lowest bit of the immediate in the slice.
+	 */
+	uint8_t imm_lsb;
+	/**
+	 * \brief \c width is the number of bits in the slice.
+	 */
+	uint8_t width;
+	/**
+	 * \brief \c inst_lsb is the instruction bit that \c imm_lsb lands on.
+	 */
+	uint8_t inst_lsb;
+};
+
+/**
+ * \brief \c fieldMask() gives a mask of the low \c width bits.
+ */
+constexpr uint64_t fieldMask(unsigned width) {
+	return (UINT64_C(1) << width) - 1;
+}
+
+/**
+ * \brief \c scatterBits() moves the slices of an immediate to where a list of \c bit_field puts them.
+ *
+ * \param [in] fields is the list of slices.
+ * \param [in] imm is the immediate.
+ * \returns The instruction bits holding the immediate.
+ */
+template <size_t N>
+constexpr uint32_t scatterBits(const bit_field (&fields)[N], int64_t imm) {
+	uint32_t instruction = 0;
+	for (const bit_field &field : fields) {
+		instruction |= (uint32_t)((((uint64_t)imm >> field.imm_lsb) & fieldMask(field.width)) << field.inst_lsb);
 	}
-	
-	for (int i = 0; i < input.size(); i++) {
-		if ((input.at(i) <= '9') && (input.at(i) >= '0')) {
-			numeric_part += ((input.at(i) - '0') * (input.size() - i - 1) * 10) + ((input.at(i) - '0') * (i == input.size() - 1));
-		} else {
-			non_numeric_part += input.at(i);
-		}
+	return instruction;
+}
+
+/**
+ * \brief \c gatherBits() is the inverse of \c scatterBits(), it collects the slices of an immediate back together.
+ *
+ * \param [in] fields is the list of slices.
+ * \param [in] instruction is the machine code.
+ * \returns The immediate, not sign extended.
+ */
+template <size_t N>
+constexpr uint64_t gatherBits(const bit_field (&fields)[N], uint32_t instruction) {
+	uint64_t imm = 0;
+	for (const bit_field &field : fields) {
+		imm |= ((instruction >> field.inst_lsb) & fieldMask(field.width)) << field.imm_lsb;
 	}
-	
-	if ((non_numeric_part.compare("x") == 0) && (numeric_part < 32)){
-		return numeric_part << offset;
-	} else if ((non_numeric_part.compare("t") == 0) && (numeric_part < 7)){
-		if (numeric_part < 3) {
-			return (5 + numeric_part) << offset;
+	return imm;
+}
+
+/**
+ * \brief \c rd_lsb, \c rs1_lsb and \c rs2_lsb are the lowest bits of the register fields, which are the same in every format.
+ */
+constexpr unsigned rd_lsb = 7, rs1_lsb = 15, rs2_lsb = 20;
+
+/**
+ * \brief \c format_layout describes the fields of one RISC-V instruction format.
+ * \details Each specialization says which register fields the format has, how wide its immediate is and how the immediate is scattered.
+ * \c format_codec turns a layout into an encoder and a decoder.
+ * \tparam FORMAT is the instruction type, the \c format column of riscv_opcodes.def.
+ */
+template <char FORMAT>
+struct format_layout;
+
+/**
+ * \brief \c format_layout for register-register instructions.
+ */
+template <>
+struct format_layout<'R'> {
+	static constexpr bool has_rd = true, has_rs1 = true, has_rs2 = true;
+	static constexpr unsigned imm_bits = 0, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 0, 0}};
+};
+
+/**
+ * \brief \c format_layout for register instructions with one source, whose \c rs2 field is part of the opcode.
+ */
+template <>
+struct format_layout<'N'> {
+	static constexpr bool has_rd = true, has_rs1 = true, has_rs2 = false;
+	static constexpr unsigned imm_bits = 0, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 0, 0}};
+};
+
+/**
+ * \brief \c format_layout for register-immediate instructions and \c jalr.
+ */
+template <>
+struct format_layout<'I'> {
+	static constexpr bool has_rd = true, has_rs1 = true, has_rs2 = false;
+	static constexpr unsigned imm_bits = 12, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 12, 20}};
+};
+
+/**
+ * \brief \c format_layout for loads, an I-type written as \c offset(rs1).
+ */
+template <>
+struct format_layout<'L'> : format_layout<'I'> {};
+
+/**
+ * \brief \c format_layout for stores.
+ */
+template <>
+struct format_layout<'S'> {
+	static constexpr bool has_rd = false, has_rs1 = true, has_rs2 = true;
+	static constexpr unsigned imm_bits = 12, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 5, 7}, {5, 7, 25}};
+};
+
+/**
+ * \brief \c format_layout for conditional branches, the offset is in multiples of 2.
+ */
+template <>
+struct format_layout<'B'> {
+	static constexpr bool has_rd = false, has_rs1 = true, has_rs2 = true;
+	static constexpr unsigned imm_bits = 13, imm_align = 1;
+	static constexpr bit_field imm[] = {{11, 1, 7}, {1, 4, 8}, {5, 6, 25}, {12, 1, 31}};
+};
+
+/**
+ * \brief \c format_layout for \c lui and \c auipc, the immediate is the upper 20 bits.
+ */
+template <>
+struct format_layout<'U'> {
+	static constexpr bool has_rd = true, has_rs1 = false, has_rs2 = false;
+	static constexpr unsigned imm_bits = 20, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 20, 12}};
+};
+
+/**
+ * \brief \c format_layout for \c jal, the offset is in multiples of 2.
+ */
+template <>
+struct format_layout<'J'> {
+	static constexpr bool has_rd = true, has_rs1 = false, has_rs2 = false;
+	static constexpr unsigned imm_bits = 21, imm_align = 1;
+	static constexpr bit_field imm[] = {{12, 8, 12}, {11, 1, 20}, {1, 10, 21}, {20, 1, 31}};
+};
+
+/**
+ * \brief \c format_layout for vector-vector instructions, \c vd, \c vs2, \c vs1.
+ * \details The mask bit of every vector format is set from \c parsed_instruction::flags.
+ */
+template <>
+struct format_layout<'V'> : format_layout<'R'> {};
+
+/**
+ * \brief \c format_layout for vector-scalar instructions, \c vd, \c vs2, \c rs1.
+ */
+template <>
+struct format_layout<'X'> : format_layout<'R'> {};
+
+/**
+ * \brief \c format_layout for vector-immediate instructions, \c vd, \c vs2, \c simm5, the immediate takes the place of \c rs1.
+ */
+template <>
+struct format_layout<'Y'> {
+	static constexpr bool has_rd = true, has_rs1 = false, has_rs2 = true;
+	static constexpr unsigned imm_bits = 5, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 5, 15}};
+};
+
+/**
+ * \brief \c format_layout for vector loads and stores, \c vd or \c vs3, \c (rs1), then the stride or index register in \c rs2.
+ */
+template <>
+struct format_layout<'E'> : format_layout<'R'> {};
+
+/**
+ * \brief \c format_layout for \c vsetvli and \c vsetivli, the immediate is the \c vtype.
+ * \details \c vsetivli keeps its 5 bit AVL in the \c rs1 field.
+ */
+template <>
+struct format_layout<'K'> {
+	static constexpr bool has_rd = true, has_rs1 = true, has_rs2 = false;
+	static constexpr unsigned imm_bits = 11, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 11, 20}};
+};
+
+/**
+ * \brief \c format_layout for atomic memory operations, \c rd, \c rs2, \c (rs1). The \c aq and \c rl bits are set from \c parsed_instruction::flags.
+ */
+template <>
+struct format_layout<'A'> : format_layout<'R'> {};
+
+/**
+ * \brief \c format_layout for \c fence, the immediate is the predecessor set above the successor set.
+ */
+template <>
+struct format_layout<'P'> {
+	static constexpr bool has_rd = false, has_rs1 = false, has_rs2 = false;
+	static constexpr unsigned imm_bits = 12, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 12, 20}};
+};
+
+/**
+ * \brief \c format_layout for instructions without operands, such as \c fence.i.
+ */
+template <>
+struct format_layout<'Z'> {
+	static constexpr bool has_rd = false, has_rs1 = false, has_rs2 = false;
+	static constexpr unsigned imm_bits = 0, imm_align = 0;
+	static constexpr bit_field imm[] = {{0, 0, 0}};
+};
+
+/**
+ * \brief \c decoded_fields holds the operands pulled back out of an instruction by \c format_codec::decode().
+ */
+struct decoded_fields {
+	uint32_t rd;
+	uint32_t rs1;
+	uint32_t rs2;
+	int64_t imm;
+};
+
+/**
+ * \brief \c format_codec is the encoder and decoder generated from a \c format_layout.
+ * \details Everything is \c constexpr and the loops only run over the layout, so the compiler unrolls them into straight-line shifts and masks.
+ * \tparam FORMAT is the instruction type, the \c format column of riscv_opcodes.def.
+ */
+template <char FORMAT>
+struct format_codec {
+	using layout = format_layout<FORMAT>;
+
+	/**
+	 * \brief \c register_bits is the instruction bits of the register fields the format has.
+	 */
+	static constexpr uint32_t register_bits = ((layout::has_rd ? 0x1fu : 0) << rd_lsb) | ((layout::has_rs1 ? 0x1fu : 0) << rs1_lsb) | ((layout::has_rs2 ? 0x1fu : 0) << rs2_lsb);
+
+	/**
+	 * \brief \c encodeImm() scatters an immediate into its instruction bits.
+	 *
+	 * \param [in] imm is the immediate, it is assumed to already be range checked.
+	 * \returns The instruction bits holding the immediate.
+	 */
+	static constexpr uint32_t encodeImm(int64_t imm) {
+		return scatterBits(layout::imm, imm);
+	}
+
+	/**
+	 * \brief \c decodeImm() gathers the immediate back out of an instruction.
+	 *
+	 * \param [in] instruction is the machine code.
+	 * \returns The sign extended immediate.
+	 */
+	static constexpr int64_t decodeImm(uint32_t instruction) {
+		if constexpr (layout::imm_bits == 0) {
+			return 0;
 		} else {
-			return (25 + numeric_part) << offset;
+			const uint64_t imm = gatherBits(layout::imm, instruction);
+			const uint64_t sign = UINT64_C(1) << (layout::imm_bits - 1);
+			return (int64_t)((imm ^ sign) - sign);
 		}
-	} else if ((non_numeric_part.compare("s") == 0) && (numeric_part < 12)){
-		if (numeric_part < 2) {
-			return (8 + numeric_part) << offset;
-		} else {
-			return (16 + numeric_part) << offset;
+	}
+
+	/**
+	 * \brief \c encode() builds an instruction from its base opcode and operands.
+	 *
+	 * \param [in] base is the opcode and function bits, the \c match column of riscv_opcodes.def.
+	 * \param [in] rd is the destination register number.
+	 * \param [in] rs1 is the first source register number.
+	 * \param [in] rs2 is the second source register number.
+	 * \param [in] imm is the immediate, it is assumed to already be range checked.
+	 * \returns The machine code.
+	 */
+	static constexpr uint32_t encode(uint32_t base, uint32_t rd, uint32_t rs1, uint32_t rs2, int64_t imm) {
+		return base |
+			   ((rd  & (layout::has_rd  ? 0x1f : 0)) << rd_lsb ) |
+			   ((rs1 & (layout::has_rs1 ? 0x1f : 0)) << rs1_lsb) |
+			   ((rs2 & (layout::has_rs2 ? 0x1f : 0)) << rs2_lsb) |
+			   encodeImm(imm);
+	}
+
+	/**
+	 * \brief \c decode() pulls the operands back out of an instruction.
+	 *
+	 * \param [in] instruction is the machine code.
+	 * \returns The register numbers and immediate, fields the format does not have are 0.
+	 */
+	static constexpr decoded_fields decode(uint32_t instruction) {
+		return {
+			(instruction >> rd_lsb ) & (layout::has_rd  ? 0x1f : 0),
+			(instruction >> rs1_lsb) & (layout::has_rs1 ? 0x1f : 0),
+			(instruction >> rs2_lsb) & (layout::has_rs2 ? 0x1f : 0),
+			decodeImm(instruction)
+		};
+	}
+
+	/**
+	 * \brief \c roundTrips() checks that \c decode() gives back what \c encode() was given.
+	 *
+	 * \details Every single bit of the immediate is tried on its own and negated, along with the ends of the range and alternating bit patterns.
+	 * \returns \c true if every value came back unchanged.
+	 */
+	static constexpr bool roundTrips() {
+		if constexpr (layout::imm_bits != 0) {
+			const int64_t low = signedMin(layout::imm_bits), high = signedMax(layout::imm_bits);
+			const int64_t align = ~(int64_t)fieldMask(layout::imm_align);
+			int64_t values[] = {low, high & align, 0, (int64_t)0x5555555555555555 & high & align, (int64_t)0xaaaaaaaaaaaaaaaa & high & align};
+			for (int64_t value : values) {
+				if (decodeImm(encodeImm(value)) != value || decodeImm(encodeImm(-value - 1 - ~align)) != -value - 1 - ~align) {
+					return false;
+				}
+			}
+			for (unsigned bit = layout::imm_align; bit + 1 < layout::imm_bits; bit++) {
+				const int64_t value = INT64_C(1) << bit;
+				if ((decodeImm(encodeImm(value)) != value) || (decodeImm(encodeImm(-value)) != -value)) {
+					return false;
+				}
+			}
+		}
+		decoded_fields fields = decode(encode(0, 31, 17, 5, 0));
+		return (fields.rd  == (layout::has_rd  ? 31u : 0u)) &&
+			   (fields.rs1 == (layout::has_rs1 ? 17u : 0u)) &&
+			   (fields.rs2 == (layout::has_rs2 ? 5u  : 0u));
+	}
+};
+
+static_assert(format_codec<'R'>::roundTrips(), "R-type encode/decode mismatch");
+static_assert(format_codec<'N'>::roundTrips(), "N-type encode/decode mismatch");
+static_assert(format_codec<'I'>::roundTrips(), "I-type encode/decode mismatch");
+static_assert(format_codec<'L'>::roundTrips(), "L-type encode/decode mismatch");
+static_assert(format_codec<'S'>::roundTrips(), "S-type encode/decode mismatch");
+static_assert(format_codec<'B'>::roundTrips(), "B-type encode/decode mismatch");
+static_assert(format_codec<'U'>::roundTrips(), "U-type encode/decode mismatch");
+static_assert(format_codec<'J'>::roundTrips(), "J-type encode/decode mismatch");
+static_assert(format_codec<'V'>::roundTrips(), "V-type encode/decode mismatch");
+static_assert(format_codec<'X'>::roundTrips(), "X-type encode/decode mismatch");
+static_assert(format_codec<'Y'>::roundTrips(), "Y-type encode/decode mismatch");
+static_assert(format_codec<'E'>::roundTrips(), "E-type encode/decode mismatch");
+static_assert(format_codec<'K'>::roundTrips(), "K-type encode/decode mismatch");
+static_assert(format_codec<'A'>::roundTrips(), "A-type encode/decode mismatch");
+static_assert(format_codec<'P'>::roundTrips(), "P-type encode/decode mismatch");
+static_assert(format_codec<'Z'>::roundTrips(), "Z-type encode/decode mismatch");
+static_assert(format_codec<'B'>::encodeImm(-2) == 0xfe000f80, "B-type immediate scattered wrongly");
+static_assert(format_codec<'J'>::encodeImm(-2) == 0xfffff000, "J-type immediate scattered wrongly");
+
+/**
+ * \brief \c item_kind says what a \c parsed_instruction holds, an instruction or one of the directives laid out with them.
+ */
+enum item_kind : uint8_t {
+	/**
+	 * \brief An instruction, 2 or 4 bytes.
+	 */
+	ITEM_INSTRUCTION,
+	/**
+	 * \brief A label, which takes no space. Its address is the address the label names.
+	 */
+	ITEM_LABEL,
+	/**
+	 * \brief A \c .byte, \c .half, \c .word or \c .dword value of \c size bytes, \c imm or the address of \c label.
+	 */
+	ITEM_DATA,
+	/**
+	 * \brief The characters of a \c .ascii or \c .asciz string, held in \c bytes.
+	 */
+	ITEM_STRING,
+	/**
+	 * \brief \c size copies of the byte \c fill, from \c .zero or \c .space.
+	 */
+	ITEM_FILL,
+	/**
+	 * \brief Padding up to the next multiple of \c imm bytes, left out if it would be more than \c limit bytes.
+	 */
+	ITEM_ALIGN
+};
+
+/**
+ * \brief \c parsed_instruction is one instruction after its operands have been read, ready to be encoded.
+ * \details Data and alignment directives are held the same way, so that everything in a section can be laid out in one pass.
+ */
+struct parsed_instruction {
+	/**
+	 * \brief \c kind is what this item is, \c ITEM_INSTRUCTION unless it came from a label or a directive.
+	 */
+	item_kind kind = ITEM_INSTRUCTION;
+	/**
+	 * \brief \c op is the opcode id, the index of the instruction in \c isa_table.
+	 */
+	uint32_t op = 0;
+	uint32_t rd = 0;
+	uint32_t rs1 = 0;
+	uint32_t rs2 = 0;
+	int64_t imm = 0;
+	/**
+	 * \brief \c flags holds instruction bits set by operands that are not a register or the immediate, such as the vector mask.
+	 * \details They are ORed into the machine code as they are.
+	 */
+	uint32_t flags = 0;
+	/**
+	 * \brief \c label is the label the immediate refers to, or empty if the immediate was a number.
+	 */
+	string label = "";
+	/**
+	 * \brief \c target is the index in the program of the \c ITEM_LABEL that \c label names.
+	 */
+	uint64_t target = 0;
+	/**
+	 * \brief \c pos is the index of the item in the program.
+	 */
+	uint64_t pos = 0;
+	/**
+	 * \brief \c section is the index in \c risc_v_assembler::sections of the section the item is in.
+	 */
+	uint32_t section = 0;
+	/**
+	 * \brief \c address is the byte address of the item, label offsets are relative to it.
+	 */
+	uint64_t address = 0;
+	/**
+	 * \brief \c size is the number of bytes the item takes, 2 if an instruction was compressed, 8 if it was relaxed and 4 if not.
+	 */
+	uint64_t size = 4;
+	/**
+	 * \brief \c bytes holds the characters of an \c ITEM_STRING.
+	 */
+	string bytes = "";
+	/**
+	 * \brief \c fill is the padding byte of an \c ITEM_FILL or \c ITEM_ALIGN, or -1 to pad with nops.
+	 */
+	int16_t fill = -1;
+	/**
+	 * \brief \c limit is the most padding an \c ITEM_ALIGN may add.
+	 */
+	uint64_t limit = UINT64_MAX;
+	/**
+	 * \brief \c compress is true if the instruction may be replaced by its C extension form.
+	 */
+	bool compress = false;
+	/**
+	 * \brief \c relax is true if the instruction may be rewritten as a two instruction sequence when its label is out of range.
+	 * \details A relaxed branch is the inverted branch over a \c jal to the label,
+	 * and a relaxed \c jal, which only \c call and \c tail make, is \c auipc and \c jalr.
+	 */
+	bool relax = false;
+	/**
+	 * \brief \c cold is true for a label that a \c .cold directive follows, whose block the hot/cold split moves to \c .text.cold.
+	 */
+	bool cold = false;
+	/**
+	 * \brief \c line and \c column locate the immediate in the source, for diagnostics.
+	 */
+	uint64_t line = 0;
+	uint64_t column = 0;
+};
+
+/**
+ * \brief \c constant_step is one instruction of the sequence \c li builds a constant with.
+ * \details Each instruction writes the destination register and reads the value the one before it left there, the first reads \c x0.
+ */
+struct constant_step {
+	uint32_t op;
+	int64_t imm;
+	/**
+	 * \brief \c twice is true if \c rs2 is the value being built too, as in \c sh1add \c rd, \c rd, \c rd, rather than \c x0.
+	 */
+	bool twice;
+};
+
+/**
+ * \brief \c optional_extension is an extension the assembler may use in the sequences it picks for pseudo-instructions.
+ * \details Writing its instructions by hand is always allowed, these only say what the target has.
+ */
+enum optional_extension : uint32_t {
+	OPTIONAL_ZBA = 1,
+	OPTIONAL_ZBB = 2
+};
+
+/**
+ * \brief \c optimization_pass is an optional pass over the program that may change which instructions are written, without changing what they do.
+ * \details None of them are run unless asked for, so by default every instruction is written as it was in the file.
+ */
+enum optimization_pass : uint32_t {
+	OPTIMIZE_PEEPHOLE = 1,
+	OPTIMIZE_SCHEDULE = 2,
+	OPTIMIZE_FUSION = 4,
+	OPTIMIZE_ALIGN_LOOPS = 8,
+	OPTIMIZE_ALIGN_TARGETS = 16,
+	OPTIMIZE_PROFILE_LAYOUT = 32,
+	OPTIMIZE_STATIC_LAYOUT = 64,
+	OPTIMIZE_SPLIT_COLD = 128,
+	OPTIMIZE_OUTLINE = 256
+};
+
+/**
+ * \brief \c latency_class groups the instructions that take the same number of cycles to give their result, for the scheduler.
+ */
+enum latency_class : uint32_t {
+	LATENCY_ALU,
+	LATENCY_LOAD,
+	LATENCY_MULTIPLY,
+	LATENCY_DIVIDE,
+	LATENCY_FLOAT,
+	LATENCY_CLASSES
+};
+
+/**
+ * \brief \c latency_names is the name of each \c latency_class, as it is written on the command line.
+ */
+constexpr const char * latency_names[LATENCY_CLASSES] = {"alu", "load", "multiply", "divide", "float"};
+
+/**
+ * \brief \c register_access is the registers an instruction reads and writes, as the scheduler sees them.
+ * \details The integer registers are numbered 0-31 and the floating point registers 32-63. \c x0 is never listed.
+ */
+struct register_access {
+	/**
+	 * \brief \c write is the register written, or \c no_register.
+	 */
+	uint32_t write;
+	uint32_t read[3];
+	uint32_t reads;
+	bool load;
+	bool store;
+	static constexpr uint32_t no_register = 64;
+};
+
+/**
+ * \brief \c program_section is one section of the output, such as \c .text or \c .data.
+ * \details Each section has its own location counter, the sections are then placed one after another in the order they were first used.
+ */
+struct program_section {
+	string name = "";
+	/**
+	 * \brief \c code is true for \c .text sections, whose alignment padding is made of nops.
+	 */
+	bool code = false;
+	/**
+	 * \brief \c nobits is true for \c .bss sections, which take up addresses but have nothing written to the output.
+	 */
+	bool nobits = false;
+	/**
+	 * \brief \c alignment is the largest alignment asked for in the section, which its start address is rounded up to.
+	 */
+	uint64_t alignment = 1;
+	/**
+	 * \brief \c base is the byte address the section starts at.
+	 */
+	uint64_t base = 0;
+	/**
+	 * \brief \c size is the number of bytes in the section.
+	 */
+	uint64_t size = 0;
+};
+
+/**
+ * \brief \c operand_batch holds resolved instructions as one array per field, the layout \c encodeBatch() works on.
+ */
+struct operand_batch {
+	vector <uint32_t> op;
+	vector <uint32_t> rd;
+	vector <uint32_t> rs1;
+	vector <uint32_t> rs2;
+	vector <int32_t> imm;
+	vector <uint32_t> flags;
+
+	/**
+	 * \brief \c push() adds an instruction to the end of the batch.
+	 *
+	 * \param [in] instruction is an instruction whose immediate has already been resolved and range checked.
+	 */
+	void push(const parsed_instruction &instruction) {
+		op.push_back(instruction.op);
+		rd.push_back(instruction.rd);
+		rs1.push_back(instruction.rs1);
+		rs2.push_back(instruction.rs2);
+		imm.push_back((int32_t)instruction.imm);
+		flags.push_back(instruction.flags);
+	}
+
+	size_t size() const {
+		return op.size();
+	}
+};
+
+/**
+ * \brief \c encodeScalar() encodes one instruction of a batch with the \c format_codec for its type.
+ *
+ * \param [in] type is the instruction type from \c isa_table.
+ * \param [in] base is the opcode and function bits from \c isa_table.
+ * \returns The machine code, or just \c base for an unknown type.
+ */
+inline uint32_t encodeScalar(uint32_t type, uint32_t base, uint32_t rd, uint32_t rs1, uint32_t rs2, int64_t imm) {
+	switch (type) {
+		case 'R': return format_codec<'R'>::encode(base, rd, rs1, rs2, imm);
+		case 'N': return format_codec<'N'>::encode(base, rd, rs1, rs2, imm);
+		case 'I': return format_codec<'I'>::encode(base, rd, rs1, rs2, imm);
+		case 'L': return format_codec<'L'>::encode(base, rd, rs1, rs2, imm);
+		case 'S': return format_codec<'S'>::encode(base, rd, rs1, rs2, imm);
+		case 'B': return format_codec<'B'>::encode(base, rd, rs1, rs2, imm);
+		case 'U': return format_codec<'U'>::encode(base, rd, rs1, rs2, imm);
+		case 'J': return format_codec<'J'>::encode(base, rd, rs1, rs2, imm);
+		case 'V': return format_codec<'V'>::encode(base, rd, rs1, rs2, imm);
+		case 'X': return format_codec<'X'>::encode(base, rd, rs1, rs2, imm);
+		case 'Y': return format_codec<'Y'>::encode(base, rd, rs1, rs2, imm);
+		case 'E': return format_codec<'E'>::encode(base, rd, rs1, rs2, imm);
+		case 'K': return format_codec<'K'>::encode(base, rd, rs1, rs2, imm);
+		case 'A': return format_codec<'A'>::encode(base, rd, rs1, rs2, imm);
+		case 'P': return format_codec<'P'>::encode(base, rd, rs1, rs2, imm);
+		case 'Z': return format_codec<'Z'>::encode(base, rd, rs1, rs2, imm);
+	}
+	return base;
+}
+
+#ifdef __AVX2__
+/**
+ * \brief \c scatterImm8() is the AVX2 form of \c format_codec::encodeImm(), it scatters eight immediates at once.
+ *
+ * \tparam FORMAT is the instruction type whose \c format_layout is used.
+ * \param [in] imm holds eight immediates.
+ * \returns The instruction bits holding each immediate.
+ */
+template <char FORMAT>
+inline __m256i scatterImm8(__m256i imm) {
+	__m256i instruction = _mm256_setzero_si256();
+	for (const bit_field &field : format_layout<FORMAT>::imm) {
+		const __m256i slice = _mm256_and_si256(_mm256_srli_epi32(imm, field.imm_lsb), _mm256_set1_epi32((int)fieldMask(field.width)));
+		instruction = _mm256_or_si256(instruction, _mm256_slli_epi32(slice, field.inst_lsb));
+	}
+	return instruction;
+}
+
+/**
+ * \brief \c selectImm8() keeps the scattered immediates of the lanes whose type is \c FORMAT.
+ *
+ * \tparam FORMAT is the instruction type whose \c format_layout is used.
+ * \param [in] type holds the instruction type of each lane.
+ * \param [in] imm holds eight immediates.
+ * \returns The scattered immediate in the matching lanes and 0 elsewhere.
+ */
+template <char FORMAT>
+inline __m256i selectImm8(__m256i type, __m256i imm) {
+	return _mm256_and_si256(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(FORMAT)), scatterImm8<FORMAT>(imm));
+}
+
+/**
+ * \brief \c selectRegisters8() gives the lanes whose type is \c FORMAT the \c format_codec::register_bits of that format, as \c encodeScalar() uses them.
+ *
+ * \tparam FORMAT is the instruction type whose \c format_layout is used.
+ * \param [in] type holds the instruction type of each lane.
+ * \returns The register field bits in the matching lanes and 0 elsewhere.
+ */
+template <char FORMAT>
+inline __m256i selectRegisters8(__m256i type) {
+	return _mm256_and_si256(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(FORMAT)), _mm256_set1_epi32((int)format_codec<FORMAT>::register_bits));
+}
+#endif
+
+/**
+ * \brief \c encodeBatch() encodes a whole batch of resolved instructions.
+ *
+ * \param [in] batch is the instructions to encode.
+ * \param [in] base is the base opcode of each opcode id, normally \c isa_encoder.match.
+ * \param [in] type is the instruction type of each opcode id, normally \c isa_encoder.format.
+ * \param [out] output receives one instruction per entry of \c batch.
+ *
+ * \details When built with AVX2 (\c -mavx2 or \c -march=native) eight instructions are encoded per step:
+ * the base opcodes and types are gathered from the table, the register fields are shifted into place and masked to the fields each lane's format has,
+ * so a register left in a field the format does not use is dropped just as \c encodeScalar() drops it, the immediate is scattered for every format and blended into the lanes of that format, and the flags are ORed in.
+ * The rest of the batch, and every instruction without AVX2, goes through \c encodeScalar().
+ */
+inline void encodeBatch(const operand_batch &batch, const uint32_t * base, const uint32_t * type, uint32_t * output) {
+	size_t i = 0;
+#ifdef __AVX2__
+	for (; i + 8 <= batch.size(); i += 8) {
+		const __m256i op = _mm256_loadu_si256((const __m256i *)&batch.op[i]);
+		const __m256i lane_base = _mm256_i32gather_epi32((const int *)base, op, 4);
+		const __m256i lane_type = _mm256_i32gather_epi32((const int *)type, op, 4);
+		const __m256i imm = _mm256_loadu_si256((const __m256i *)&batch.imm[i]);
+
+		__m256i fields = _mm256_or_si256(selectRegisters8<'R'>(lane_type), selectRegisters8<'N'>(lane_type));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'I'>(lane_type), selectRegisters8<'L'>(lane_type)));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'S'>(lane_type), selectRegisters8<'B'>(lane_type)));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'U'>(lane_type), selectRegisters8<'J'>(lane_type)));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'V'>(lane_type), selectRegisters8<'X'>(lane_type)));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'Y'>(lane_type), selectRegisters8<'E'>(lane_type)));
+		fields = _mm256_or_si256(fields, _mm256_or_si256(selectRegisters8<'K'>(lane_type), selectRegisters8<'A'>(lane_type)));
+
+		const __m256i registers = _mm256_or_si256(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)&batch.rd[i]), rd_lsb),
+								  _mm256_or_si256(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)&batch.rs1[i]), rs1_lsb),
+												  _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)&batch.rs2[i]), rs2_lsb)));
+		__m256i instruction = _mm256_or_si256(lane_base, _mm256_and_si256(registers, fields));
+
+		instruction = _mm256_or_si256(instruction, _mm256_or_si256(selectImm8<'I'>(lane_type, imm), selectImm8<'L'>(lane_type, imm)));
+		instruction = _mm256_or_si256(instruction, _mm256_or_si256(selectImm8<'S'>(lane_type, imm), selectImm8<'B'>(lane_type, imm)));
+		instruction = _mm256_or_si256(instruction, _mm256_or_si256(selectImm8<'U'>(lane_type, imm), selectImm8<'J'>(lane_type, imm)));
+		instruction = _mm256_or_si256(instruction, _mm256_or_si256(selectImm8<'Y'>(lane_type, imm), selectImm8<'K'>(lane_type, imm)));
+		instruction = _mm256_or_si256(instruction, selectImm8<'P'>(lane_type, imm));
+		instruction = _mm256_or_si256(instruction, _mm256_loadu_si256((const __m256i *)&batch.flags[i]));
+
+		_mm256_storeu_si256((__m256i *)&output[i], instruction);
+	}
+#endif
+	for (; i < batch.size(); i++) {
+		output[i] = encodeScalar(type[batch.op[i]], base[batch.op[i]], batch.rd[i], batch.rs1[i], batch.rs2[i], batch.imm[i]) | batch.flags[i];
+	}
+}
+
+/**
+ * \brief \c xlen_traits describes the base integer ISA that is being assembled for.
+ * \details Only the RV32 and RV64 specializations exist, so any other width will not compile.
+ */
+template <unsigned XLEN>
+struct xlen_traits;
+
+/**
+ * \brief \c xlen_traits for RV32I.
+ */
+template <>
+struct xlen_traits<32> {
+	/**
+	 * \brief \c rv64 is true when the RV64-only instructions are available.
+	 */
+	static constexpr bool rv64 = false;
+	/**
+	 * \brief \c shamt_bits is the width of the shift amount of \c slli, \c srli and \c srai.
+	 */
+	static constexpr unsigned shamt_bits = 5;
+	/**
+	 * \brief \c name is the name of the base ISA, for diagnostics.
+	 */
+	static constexpr const char * name = "RV32I";
+};
+
+/**
+ * \brief \c xlen_traits for RV64I.
+ */
+template <>
+struct xlen_traits<64> {
+	/**
+	 * \brief \c rv64 is true when the RV64-only instructions are available.
+	 */
+	static constexpr bool rv64 = true;
+	/**
+	 * \brief \c shamt_bits is the width of the shift amount of \c slli, \c srli and \c srai.
+	 */
+	static constexpr unsigned shamt_bits = 6;
+	/**
+	 * \brief \c name is the name of the base ISA, for diagnostics.
+	 */
+	static constexpr const char * name = "RV64I";
+};
+
+/**
+ * \brief \c isa_extension names the extension an instruction in riscv_opcodes.def belongs to.
+ * \details The \c RV64_ extensions hold the instructions that only exist when \c XLEN is 64, and the \c RV32_ ones those that only exist when it is 32,
+ * which lets an instruction whose encoding depends on \c XLEN (such as \c rev8) have a line for each.
+ */
+enum isa_extension : uint8_t {
+	RV_I,
+	RV64_I,
+	RV_M,
+	RV64_M,
+	RV_ZBA,
+	RV64_ZBA,
+	RV_ZBB,
+	RV32_ZBB,
+	RV64_ZBB,
+	RV_ZBS,
+	RV_V,
+	RV64_V,
+	RV_A,
+	RV64_A,
+	RV_ZIFENCEI,
+	RV_ZICBOM,
+	RV_ZICBOZ,
+	RV_ZICBOP,
+	RV_ZIHINTPAUSE,
+	RV_ZIHINTNTL,
+	RV_F,
+	RV64_F,
+	RV_D,
+	RV64_D,
+	RV_ZICSR,
+	RV_ZICNTR,
+	RV32_ZICNTR,
+	RV_ZICOND
+};
+
+/**
+ * \brief \c inXlen() tells if an extension exists for a given \c XLEN.
+ */
+constexpr bool inXlen(isa_extension extension, unsigned xlen) {
+	switch (extension) {
+		case RV64_I:
+		case RV64_M:
+		case RV64_ZBA:
+		case RV64_ZBB:
+		case RV64_V:
+		case RV64_A:
+		case RV64_F:
+		case RV64_D:
+			return xlen == 64;
+		case RV32_ZBB:
+		case RV32_ZICNTR:
+			return xlen == 32;
+		default:
+			return true;
+	}
+}
+
+/**
+ * \brief \c isa_entry is one line of riscv_opcodes.def.
+ */
+struct isa_entry {
+	const char * mnemonic;
+	char format;
+	uint32_t match;
+	uint32_t mask;
+	isa_extension extension;
+};
+
+/**
+ * \brief \c isa_table is every instruction the assembler knows, the index into it is the opcode id.
+ */
+constexpr isa_entry isa_table[] = {
+#define RISCV_INSTRUCTION(mnemonic, format, match, mask, extension) {mnemonic, format, match, mask, extension},
+#include "riscv_opcodes.def"
+#undef RISCV_INSTRUCTION
+};
+
+/**
+ * \brief \c isa_size is the number of instructions in \c isa_table.
+ */
+constexpr uint32_t isa_size = sizeof(isa_table) / sizeof(isa_table[0]);
+
+/**
+ * \brief \c isa_columns is \c isa_table split into the arrays that \c encodeBatch() gathers from.
+ */
+struct isa_columns {
+	uint32_t match[isa_size];
+	uint32_t format[isa_size];
+};
+
+/**
+ * \brief \c encodingFormat() gives the format whose \c format_layout encodes a format.
+ * \details The floating point formats only differ from the integer ones in their register names, so they share their layouts.
+ * The CSR accesses are I-type, with the CSR number as the immediate.
+ * The \c rs3 of the fused multiply-adds and the rounding modes are set from \c parsed_instruction::flags.
+ */
+constexpr char encodingFormat(char format) {
+	switch (format) {
+		case 'C':
+		case 'W': return 'I';
+		case 'l': return 'L';
+		case 's': return 'S';
+		case 'r':
+		case 'G':
+		case 'H':
+		case 'Q': return 'R';
+		default:  return format;
+	}
+}
+
+/**
+ * \brief \c buildEncoderTable() fills an \c isa_columns from \c isa_table.
+ */
+constexpr isa_columns buildEncoderTable() {
+	isa_columns table{};
+	for (uint32_t id = 0; id < isa_size; id++) {
+		table.match[id] = isa_table[id].match;
+		table.format[id] = encodingFormat(isa_table[id].format);
+	}
+	return table;
+}
+
+/**
+ * \brief \c isa_encoder is the encoder table, the base opcode and type of every opcode id.
+ */
+constexpr isa_columns isa_encoder = buildEncoderTable();
+
+/**
+ * \brief \c mnemonicLength() is a \c constexpr \c strlen().
+ */
+constexpr size_t mnemonicLength(const char * mnemonic) {
+	size_t length = 0;
+	while (mnemonic[length] != '\0') {
+		length++;
+	}
+	return length;
+}
+
+/**
+ * \brief \c mnemonicHash() is a seeded FNV-1a hash of a mnemonic, used by \c name_hash.
+ *
+ * \param [in] mnemonic is the characters to be hashed.
+ * \param [in] length is the number of characters.
+ * \param [in] seed picks one of a family of hash functions.
+ * \returns The hash.
+ */
+constexpr uint32_t mnemonicHash(const char * mnemonic, size_t length, uint32_t seed) {
+	uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)mnemonic[i];
+		hash *= 16777619u;
+	}
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+/**
+ * \brief \c nextPowerOfTwo() rounds up to a power of two.
+ */
+constexpr uint32_t nextPowerOfTwo(uint32_t value) {
+	uint32_t power = 1;
+	while (power < value) {
+		power <<= 1;
+	}
+	return power;
+}
+
+/**
+ * \brief \c name_hash is a perfect hash from a name to its index in a table, built at compile time.
+ * \details The name is hashed once to pick a bucket, and again with that bucket's seed to pick a slot.
+ * The seeds are searched for when the table is built so that no two names share a slot, so a lookup is two hashes and one string compare.
+ * \tparam KEYS describes the table: its \c size, the \c name() of each index and whether it is \c present() for an \c XLEN.
+ * \tparam XLEN leaves the names of the other \c XLEN out of the table.
+ */
+template <typename KEYS, unsigned XLEN>
+struct name_hash {
+	static constexpr uint32_t buckets = nextPowerOfTwo(KEYS::size / 4 + 1);
+	static constexpr uint32_t slots = nextPowerOfTwo(2 * KEYS::size);
+	static constexpr uint16_t empty = 0xffff;
+
+	/**
+	 * \brief \c built is false if no set of seeds could be found.
+	 */
+	bool built = false;
+	uint16_t seed[buckets] = {};
+	uint16_t slot[slots] = {};
+
+	/**
+	 * \brief \c build() searches for a seed for every bucket, largest buckets first.
+	 */
+	static constexpr name_hash build() {
+		name_hash table{};
+		uint32_t bucket_of[KEYS::size] = {};
+		uint32_t bucket_size[buckets] = {};
+		uint32_t largest = 0;
+
+		for (uint32_t i = 0; i < slots; i++) {
+			table.slot[i] = empty;
+		}
+		for (uint32_t id = 0; id < KEYS::size; id++) {
+			if (!KEYS::present(id, XLEN)) {
+				continue;
+			}
+			bucket_of[id] = mnemonicHash(KEYS::name(id), mnemonicLength(KEYS::name(id)), 0) & (buckets - 1);
+			bucket_size[bucket_of[id]]++;
+			if (bucket_size[bucket_of[id]] > largest) {
+				largest = bucket_size[bucket_of[id]];
+			}
+		}
+
+		for (uint32_t size = largest; size > 0; size--) {
+			for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+				if (bucket_size[bucket] != size) {
+					continue;
+				}
+
+				uint32_t members[KEYS::size] = {};
+				uint32_t count = 0;
+				for (uint32_t id = 0; id < KEYS::size; id++) {
+					if (KEYS::present(id, XLEN) && (bucket_of[id] == bucket)) {
+						members[count++] = id;
+					}
+				}
+
+				bool placed = false;
+				for (uint32_t seed = 1; (seed < empty) && !placed; seed++) {
+					uint32_t positions[KEYS::size] = {};
+					placed = true;
+					for (uint32_t i = 0; (i < count) && placed; i++) {
+						positions[i] = mnemonicHash(KEYS::name(members[i]), mnemonicLength(KEYS::name(members[i])), seed) & (slots - 1);
+						placed = (table.slot[positions[i]] == empty);
+						for (uint32_t j = 0; (j < i) && placed; j++) {
+							placed = (positions[j] != positions[i]);
+						}
+					}
+					if (placed) {
+						table.seed[bucket] = seed;
+						for (uint32_t i = 0; i < count; i++) {
+							table.slot[positions[i]] = members[i];
+						}
+					}
+				}
+				if (!placed) {
+					return table;
+				}
+			}
+		}
+		table.built = true;
+		return table;
+	}
+
+	/**
+	 * \brief \c find() looks up a name.
+	 *
+	 * \param [in] name is the name to be looked up.
+	 * \returns The index, or -1 if the name is not in the table.
+	 */
+	int32_t find(const string &name) const {
+		const uint32_t bucket = mnemonicHash(name.data(), name.size(), 0) & (buckets - 1);
+		const uint16_t id = slot[mnemonicHash(name.data(), name.size(), seed[bucket]) & (slots - 1)];
+		if ((id == empty) || (name.compare(KEYS::name(id)) != 0)) {
+			return -1;
+		}
+		return id;
+	}
+};
+
+/**
+ * \brief \c isa_keys describes \c isa_table to \c name_hash.
+ */
+struct isa_keys {
+	static constexpr uint32_t size = isa_size;
+	static constexpr const char * name(uint32_t id) { return isa_table[id].mnemonic; }
+	static constexpr bool present(uint32_t id, unsigned xlen) { return inXlen(isa_table[id].extension, xlen); }
+};
+
+/**
+ * \brief \c mnemonic_table is the perfect hash from mnemonic to opcode id for each \c XLEN.
+ */
+template <unsigned XLEN>
+constexpr name_hash<isa_keys, XLEN> mnemonic_table = name_hash<isa_keys, XLEN>::build();
+
+/**
+ * \brief \c csr_entry is one line of riscv_csrs.def.
+ */
+struct csr_entry {
+	const char * name;
+	uint16_t number;
+	unsigned xlen;
+};
+
+/**
+ * \brief \c csr_table is every control and status register the assembler knows by name.
+ */
+constexpr csr_entry csr_table[] = {
+#define RISCV_CSR(name, number, xlen) {name, number, xlen},
+#include "riscv_csrs.def"
+#undef RISCV_CSR
+};
+
+/**
+ * \brief \c csr_keys describes \c csr_table to \c name_hash.
+ */
+struct csr_keys {
+	static constexpr uint32_t size = sizeof(csr_table) / sizeof(csr_table[0]);
+	static constexpr const char * name(uint32_t id) { return csr_table[id].name; }
+	static constexpr bool present(uint32_t id, unsigned xlen) { return (csr_table[id].xlen == 0) || (csr_table[id].xlen == xlen); }
+};
+
+/**
+ * \brief \c csr_names is the perfect hash from CSR name to \c csr_table index for each \c XLEN.
+ */
+template <unsigned XLEN>
+constexpr name_hash<csr_keys, XLEN> csr_names = name_hash<csr_keys, XLEN>::build();
+
+/**
+ * \brief \c maskBits() counts the bits an instruction's mask fixes.
+ */
+constexpr uint32_t maskBits(uint32_t mask) {
+	uint32_t count = 0;
+	for (; mask != 0; mask &= mask - 1) {
+		count++;
+	}
+	return count;
+}
+
+/**
+ * \brief \c isa_decoder is the decoder table, it finds the opcode id of a piece of machine code.
+ * \details The opcode ids are grouped by their major opcode (the low 7 bits) and within a group the most specific mask comes first,
+ * so the first entry that matches is the instruction.
+ */
+struct isa_decoder {
+	uint16_t order[isa_size] = {};
+	uint16_t first[129] = {};
+
+	/**
+	 * \brief \c sortKey() orders opcode ids by major opcode, then by mask, most bits first.
+	 */
+	static constexpr uint32_t sortKey(uint32_t id) {
+		return ((isa_table[id].match & 0x7f) << 8) | (32 - maskBits(isa_table[id].mask));
+	}
+
+	/**
+	 * \brief \c build() sorts the opcode ids and finds where each major opcode starts.
+	 */
+	static constexpr isa_decoder build() {
+		isa_decoder table{};
+		for (uint32_t id = 0; id < isa_size; id++) {
+			uint32_t i = id;
+			while ((i > 0) && (sortKey(table.order[i - 1]) > sortKey(id))) {
+				table.order[i] = table.order[i - 1];
+				i--;
+			}
+			table.order[i] = id;
+		}
+		uint32_t i = 0;
+		for (uint32_t major = 0; major <= 128; major++) {
+			while ((i < isa_size) && ((isa_table[table.order[i]].match & 0x7f) < major)) {
+				i++;
+			}
+			table.first[major] = i;
+		}
+		return table;
+	}
+
+	/**
+	 * \brief \c decode() finds the instruction a piece of machine code is.
+	 *
+	 * \param [in] instruction is the machine code.
+	 * \returns The opcode id, or -1 if it is not an instruction the assembler knows.
+	 */
+	constexpr int32_t decode(uint32_t instruction) const {
+		const uint32_t major = instruction & 0x7f;
+		for (uint32_t i = first[major]; i < first[major + 1]; i++) {
+			if ((instruction & isa_table[order[i]].mask) == isa_table[order[i]].match) {
+				return order[i];
+			}
+		}
+		return -1;
+	}
+};
+
+/**
+ * \brief \c instruction_decoder is the decoder table for \c isa_table.
+ */
+constexpr isa_decoder instruction_decoder = isa_decoder::build();
+
+/**
+ * \brief \c isaTableIsConsistent() checks riscv_opcodes.def for mistakes.
+ * \details Every \c match must lie inside its \c mask, and decoding every \c match must give back its own instruction
+ * unless a more specific instruction claims it, so two instructions can not share an encoding.
+ */
+constexpr bool isaTableIsConsistent() {
+	for (uint32_t id = 0; id < isa_size; id++) {
+		if ((isa_table[id].match & ~isa_table[id].mask) != 0) {
+			return false;
+		}
+		const int32_t decoded = instruction_decoder.decode(isa_table[id].match);
+		if ((decoded != (int32_t)id) && ((decoded < 0) || (maskBits(isa_table[decoded].mask) <= maskBits(isa_table[id].mask)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(isaTableIsConsistent(), "riscv_opcodes.def has an instruction whose encoding is outside its mask or is shared with another instruction");
+static_assert(mnemonic_table<32>.built && mnemonic_table<64>.built, "no perfect hash could be found for riscv_opcodes.def");
+static_assert(csr_names<32>.built && csr_names<64>.built, "no perfect hash could be found for riscv_csrs.def");
+
+/**
+ * \brief \c isaId() finds the opcode id of a mnemonic at compile time, so it can be used as a \c case label.
+ *
+ * \param [in] mnemonic is the instruction to be looked up.
+ * \returns The opcode id, or \c isa_size if the mnemonic is not in riscv_opcodes.def.
+ */
+constexpr uint32_t isaId(const char * mnemonic) {
+	for (uint32_t id = 0; id < isa_size; id++) {
+		const char * name = isa_table[id].mnemonic;
+		size_t i = 0;
+		while ((name[i] != '\0') && (name[i] == mnemonic[i])) {
+			i++;
+		}
+		if (name[i] == mnemonic[i]) {
+			return id;
+		}
+	}
+	return isa_size;
+}
+
+/**
+ * \brief The \c rvc_ arrays give the immediate scatter of each compressed (C extension) instruction shape.
+ * \details They are used with \c scatterBits() by \c risc_v_assembler::compressInstruction().
+ */
+constexpr bit_field rvc_ci_imm[]       = {{5, 1, 12}, {0, 5, 2}};
+constexpr bit_field rvc_addi16sp_imm[] = {{9, 1, 12}, {4, 1, 6}, {6, 1, 5}, {7, 2, 3}, {5, 1, 2}};
+constexpr bit_field rvc_addi4spn_imm[] = {{4, 2, 11}, {6, 4, 7}, {2, 1, 6}, {3, 1, 5}};
+constexpr bit_field rvc_lwsp_imm[]     = {{5, 1, 12}, {2, 3, 4}, {6, 2, 2}};
+constexpr bit_field rvc_ldsp_imm[]     = {{5, 1, 12}, {3, 2, 5}, {6, 3, 2}};
+constexpr bit_field rvc_swsp_imm[]     = {{2, 4, 9}, {6, 2, 7}};
+constexpr bit_field rvc_sdsp_imm[]     = {{3, 3, 10}, {6, 3, 7}};
+constexpr bit_field rvc_lw_imm[]       = {{3, 3, 10}, {2, 1, 6}, {6, 1, 5}};
+constexpr bit_field rvc_ld_imm[]       = {{3, 3, 10}, {6, 2, 5}};
+constexpr bit_field rvc_b_imm[]        = {{8, 1, 12}, {3, 2, 10}, {6, 2, 5}, {1, 2, 3}, {5, 1, 2}};
+constexpr bit_field rvc_j_imm[]        = {{11, 1, 12}, {4, 1, 11}, {8, 2, 9}, {10, 1, 8}, {6, 1, 7}, {7, 1, 6}, {1, 3, 3}, {5, 1, 2}};
+
+static_assert(scatterBits(rvc_j_imm, -2) == 0x1ffc, "c.j immediate scattered wrongly");
+static_assert(scatterBits(rvc_b_imm, -2) == 0x1c7c, "c.beqz immediate scattered wrongly");
+static_assert(gatherBits(rvc_addi16sp_imm, scatterBits(rvc_addi16sp_imm, 0x3f0)) == 0x3f0, "c.addi16sp immediate scattered wrongly");
+
+/**
+ * \brief \c rvcRegister() tells if a register is one of x8-x15, the only ones a 3 bit compressed register field can hold.
+ */
+constexpr bool rvcRegister(uint32_t reg) {
+	return (reg >= 8) && (reg <= 15);
+}
+
+/**
+ * \brief \c fitsImmediate() tells if an immediate is in a range and a multiple of a power of two.
+ *
+ * \param [in] value is the immediate.
+ * \param [in] low is the smallest allowed value.
+ * \param [in] high is the largest allowed value.
+ * \param [in] align is the power of two the value must be a multiple of.
+ */
+constexpr bool fitsImmediate(int64_t value, int64_t low, int64_t high, int64_t align = 1) {
+	return (value >= low) && (value <= high) && ((value & (align - 1)) == 0);
+}
+
+/**
+ * \brief \c copiedRegister() tells if an instruction does nothing but copy one register into \c rd.
+ *
+ * \param [in] instruction is the instruction.
+ * \param [out] source receives the register that is copied.
+ * \returns \c true if the instruction is a copy.
+ */
+inline bool copiedRegister(const parsed_instruction &instruction, uint32_t &source) {
+	if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.label.size() != 0)) {
+		return false;
+	}
+	switch (instruction.op) {
+		case isaId("addi"):
+		case isaId("ori"):
+		case isaId("xori"):
+			source = instruction.rs1;
+			return instruction.imm == 0;
+		case isaId("add"):
+		case isaId("or"):
+		case isaId("xor"):
+			source = (instruction.rs2 == 0) ? instruction.rs1 : instruction.rs2;
+			return (instruction.rs1 == 0) || (instruction.rs2 == 0);
+		case isaId("sub"):
+			source = instruction.rs1;
+			return instruction.rs2 == 0;
+		default:
+			return false;
+	}
+}
+
+/**
+ * \brief \c loadedConstant() tells if an instruction sets \c rd to a constant, as the \c addi or \c lui of a short \c li does.
+ *
+ * \param [in] instruction is the instruction.
+ * \param [out] value receives the constant.
+ * \returns \c true if the instruction sets a constant.
+ */
+inline bool loadedConstant(const parsed_instruction &instruction, int64_t &value) {
+	if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.label.size() != 0) || (instruction.rd == 0)) {
+		return false;
+	}
+	if ((instruction.op == isaId("addi")) && (instruction.rs1 == 0)) {
+		value = instruction.imm;
+		return true;
+	}
+	if (instruction.op == isaId("lui")) {
+		value = signExtend(instruction.imm << 12, 32);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * \brief \c latencyClass() finds the \c latency_class of an instruction.
+ */
+constexpr latency_class latencyClass(uint32_t op) {
+	const isa_extension extension = isa_table[op].extension;
+	if ((isa_table[op].format == 'L') || (isa_table[op].format == 'l')) {
+		return LATENCY_LOAD;
+	}
+	if ((extension == RV_M) || (extension == RV64_M)) {
+		return (isa_table[op].mnemonic[0] == 'm') ? LATENCY_MULTIPLY : LATENCY_DIVIDE;
+	}
+	if ((extension == RV_F) || (extension == RV64_F) || (extension == RV_D) || (extension == RV64_D)) {
+		return LATENCY_FLOAT;
+	}
+	return LATENCY_ALU;
+}
+
+/**
+ * \brief \c registerAccess() finds the registers an instruction reads and writes, and if it may be moved by the scheduler at all.
+ *
+ * \param [in] instruction is the instruction.
+ * \param [out] access receives the registers and memory accesses.
+ * \returns \c false if the instruction must stay where it is.
+ *
+ * \details Only the integer, multiply, bit manipulation, \c czero and floating point instructions may be moved, and the plain loads and stores.
+ * Jumps, branches, \c auipc and anything with a label operand depend on their address, and CSR, fence, atomic, cache, hint and vector
+ * instructions have effects the registers do not show, so they all stay where they are.
+ */
+inline bool registerAccess(const parsed_instruction &instruction, register_access &access) {
+	const isa_extension extension = isa_table[instruction.op].extension;
+	const char format = isa_table[instruction.op].format;
+	uint32_t write = 0, read[3] = {0, 0, 0}, reads = 0;
+
+	access = {register_access::no_register, {0, 0, 0}, 0, false, false};
+	if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.label.size() != 0) || (instruction.op == isaId("jalr")) || (instruction.op == isaId("auipc"))) {
+		return false;
+	}
+	switch (extension) {
+		case RV_I: case RV64_I: case RV_M: case RV64_M: case RV_ZBA: case RV64_ZBA: case RV_ZBB: case RV32_ZBB: case RV64_ZBB: case RV_ZBS:
+		case RV_ZICOND: case RV_F: case RV64_F: case RV_D: case RV64_D:
+		break;
+		default:
+			return false;
+	}
+
+	switch (format) {
+		case 'R': write = instruction.rd; read[0] = instruction.rs1; read[1] = instruction.rs2; reads = 2; break;
+		case 'N': case 'I': write = instruction.rd; read[0] = instruction.rs1; reads = 1; break;
+		case 'U': write = instruction.rd; break;
+		case 'L': write = instruction.rd; read[0] = instruction.rs1; reads = 1; access.load = true; break;
+		case 'S': read[0] = instruction.rs1; read[1] = instruction.rs2; reads = 2; access.store = true; break;
+		case 'l': write = 32 + instruction.rd; read[0] = instruction.rs1; reads = 1; access.load = true; break;
+		case 's': read[0] = instruction.rs1; read[1] = 32 + instruction.rs2; reads = 2; access.store = true; break;
+		case 'r': write = 32 + instruction.rd; read[0] = 32 + instruction.rs1; read[1] = 32 + instruction.rs2; reads = 2; break;
+		case 'Q': write = 32 + instruction.rd; read[0] = 32 + instruction.rs1; read[1] = 32 + instruction.rs2; read[2] = 32 + ((instruction.flags >> 27) & 31); reads = 3; break;
+		case 'G': write = instruction.rd; read[0] = 32 + instruction.rs1; read[1] = 32 + instruction.rs2; reads = 2; break;
+		case 'H': write = 32 + instruction.rd; read[0] = instruction.rs1; reads = 1; break;
+		default:
+			return false;
+	}
+
+	if (write != 0) {
+		access.write = write;
+	}
+	for (uint32_t i = 0; i < reads; i++) {
+		if (read[i] != 0) {
+			access.read[access.reads++] = read[i];
+		}
+	}
+	return true;
+}
+
+/**
+ * \brief \c commutes() tells if two instructions next to each other may be swapped without changing what the program does.
+ *
+ * \param [in] first is the instruction that comes first.
+ * \param [in] second is the instruction straight after it.
+ *
+ * \details Both must be allowed to move by \c registerAccess(), neither may read or write a register the other writes,
+ * and they may not both access memory unless both are loads.
+ */
+inline bool commutes(const parsed_instruction &first, const parsed_instruction &second) {
+	register_access a, b;
+	if (!registerAccess(first, a) || !registerAccess(second, b)) {
+		return false;
+	}
+	if ((a.write != register_access::no_register) && (a.write == b.write)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < a.reads; i++) {
+		if (a.read[i] == b.write) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < b.reads; i++) {
+		if (b.read[i] == a.write) {
+			return false;
+		}
+	}
+	return !((a.store && (b.load || b.store)) || (a.load && b.store));
+}
+
+/**
+ * \brief \c suffixArray() sorts the suffixes of a string and finds how long a prefix each shares with the one before it.
+ *
+ * \param [in] text is the string, of any symbols.
+ * \param [out] suffixes receives the start of each suffix, in sorted order.
+ * \param [out] common receives the length of the prefix each suffix in \c suffixes shares with the one before it, 0 for the first.
+ *
+ * \details The suffixes are sorted by prefix doubling, ranking them by their first 1, 2, 4... symbols until no two ranks are the same,
+ * and the common prefixes are then found in linear time by Kasai's method, which uses the fact that a suffix one shorter shares at least one less.
+ */
+inline void suffixArray(const vector <uint32_t> &text, vector <uint32_t> &suffixes, vector <uint32_t> &common) {
+	const uint32_t size = (uint32_t)text.size();
+	vector <uint32_t> rank(text.begin(), text.end()), next(size);
+
+	suffixes.resize(size);
+	common.assign(size, 0);
+	for (uint32_t i = 0; i < size; i++) {
+		suffixes[i] = i;
+	}
+	for (uint32_t length = 1; size != 0; length *= 2) {
+		const auto key = [&](uint32_t i) { return make_pair(rank[i], (i + length < size) ? (uint64_t)rank[i + length] + 1 : 0); };
+		sort(suffixes.begin(), suffixes.end(), [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+		next[suffixes[0]] = 0;
+		for (uint32_t i = 1; i < size; i++) {
+			next[suffixes[i]] = next[suffixes[i - 1]] + (key(suffixes[i - 1]) < key(suffixes[i]));
+		}
+		rank.swap(next);
+		if ((rank[suffixes[size - 1]] == size - 1) || (length >= size)) {
+			break;
+		}
+	}
+
+	for (uint32_t i = 0; i < size; i++) {
+		next[suffixes[i]] = i;
+	}
+	uint32_t shared = 0;
+	for (uint32_t i = 0; i < size; i++) {
+		if (next[i] == 0) {
+			shared = 0;
+			continue;
+		}
+		const uint32_t before = suffixes[next[i] - 1];
+		while ((i + shared < size) && (before + shared < size) && (text[i + shared] == text[before + shared])) {
+			shared++;
+		}
+		common[next[i]] = shared;
+		shared -= (shared != 0);
+	}
+}
+
+/**
+ * \brief \c fusion_pair is two instructions that a core runs as one when they are next to each other, write the same \c rd
+ * and the second reads the first's result.
+ */
+struct fusion_pair {
+	uint32_t first;
+	uint32_t second;
+};
+
+/**
+ * \brief \c code_block is one basic block of a code section, as the block layout passes see it.
+ * \details A block starts at any alignment or label that follows other items, and after any branch or jump, and holds everything up to the next start.
+ */
+struct code_block {
+	/**
+	 * \brief \c items is the position in the program of each item in the block, in order.
+	 */
+	vector <uint64_t> items;
+	/**
+	 * \brief \c label is the position of the first label the block starts with, or \c no_label if it starts with none.
+	 */
+	uint64_t label = no_label;
+	/**
+	 * \brief \c taken is the block the branch or jump that ends this one goes to, or \c no_block if it goes outside the section or there is none.
+	 */
+	uint32_t taken = no_block;
+	/**
+	 * \brief \c next is the block this one falls through to in the original order, which is the number of blocks for the end of the section,
+	 * or \c no_block if it ends with a jump and can not fall through.
+	 */
+	uint32_t next = no_block;
+	/**
+	 * \brief \c conditional is true if the block ends with a conditional branch, so it may go to both \c taken and \c next.
+	 */
+	bool conditional = false;
+	/**
+	 * \brief \c entry is true if the block starts a function, the first block of the section or one that is called.
+	 */
+	bool entry = false;
+	/**
+	 * \brief \c function is the index of the block that starts the function the block is in.
+	 */
+	uint32_t function = 0;
+	/**
+	 * \brief \c count is the number of times the block is expected to run.
+	 */
+	uint64_t count = 0;
+	/**
+	 * \brief \c cold is true if the block is to be moved out of its section into \c .text.cold.
+	 */
+	bool cold = false;
+	static constexpr uint32_t no_block = UINT32_MAX;
+	static constexpr uint64_t no_label = UINT64_MAX;
+};
+
+/**
+ * \brief \c outline_candidate is a sequence of instructions the outliner found more than once.
+ */
+struct outline_candidate {
+	/**
+	 * \brief \c length is the number of instructions in the sequence.
+	 */
+	uint32_t length;
+	/**
+	 * \brief \c starts is where each copy starts in the outliner's string of instructions, in order and not overlapping.
+	 */
+	vector <uint32_t> starts;
+	/**
+	 * \brief \c benefit is the number of bytes outlining every copy would save.
+	 */
+	int64_t benefit;
+};
+
+/**
+ * \brief \c risc_v_assembler is a class that allows for the assembly of RISC-V into a file.
+ * \tparam XLEN is the width of the integer registers, either 32 or 64.
+ * \note If you would like a binary executable, edit the fprintf statement in the \c process() function.
+ */
+template <unsigned XLEN>
+class risc_v_assembler {
+	protected:
+		/**
+		 * \brief \c input_file holds the name of the input file.
+		 */
+		char * input_file = nullptr;
+		/**
+		 * \brief \c output_file holds the name of the output file.
+		 */
+		char * output_file = nullptr;
+		/**
+		 * \brief \c labels holds the index in \c program of the \c ITEM_LABEL of every label in the file.
+		 */
+		map <string, uint64_t> labels;
+		/**
+		 * \brief \c diagnostics holds every error found by the last call to \c process().
+		 */
+		vector <diagnostic> diagnostics;
+		/**
+		 * \brief \c current_line holds the source line being assembled, for diagnostics.
+		 */
+		uint64_t current_line = 0;
+		/**
+		 * \brief \c current_column holds the column of the token being assembled, for diagnostics.
+		 */
+		uint64_t current_column = 0;
+		/**
+		 * \brief \c program holds every instruction, label and data directive read from the file, in order.
+		 */
+		vector <parsed_instruction> program;
+		/**
+		 * \brief \c program_size is the number of bytes in \c program once it has been laid out, from address 0 to the end of the last section.
+		 */
+		uint64_t program_size = 0;
+		/**
+		 * \brief \c sections holds every section used so far, \c .text is always the first.
+		 */
+		vector <program_section> sections;
+		/**
+		 * \brief \c current_section is the index in \c sections that new items are added to.
+		 */
+		uint32_t current_section = 0;
+		/**
+		 * \brief \c rvc is true if instructions should be compressed where they can be, set on the command line.
+		 */
+		bool rvc = false;
+		/**
+		 * \brief \c rvc_active is \c rvc as changed by the \c .option directives read so far.
+		 */
+		bool rvc_active = false;
+		/**
+		 * \brief \c extensions is the \c optional_extension bits the target has, set on the command line.
+		 */
+		uint32_t extensions = 0;
+		/**
+		 * \brief \c extensions_active is \c extensions as changed by the \c .option \c arch directives read so far.
+		 */
+		uint32_t extensions_active = 0;
+		/**
+		 * \brief \c optimizations is the \c optimization_pass bits to run, set on the command line.
+		 */
+		uint32_t optimizations = 0;
+		/**
+		 * \brief \c latencies is the number of cycles after an instruction of each \c latency_class that its result may be used without a stall.
+		 * \details The defaults are those of a simple in-order pipeline whose loads stall an instruction that uses them straight after.
+		 */
+		uint32_t latencies[LATENCY_CLASSES] = {1, 2, 3, 20, 4};
+		/**
+		 * \brief \c fetch_block is the number of bytes the core fetches at once, which branch targets are aligned to.
+		 */
+		uint64_t fetch_block = 16;
+		/**
+		 * \brief \c padding_limit is the most padding that may be added before one branch target, a target that would need more is left where it is.
+		 */
+		uint64_t padding_limit = UINT64_MAX;
+		/**
+		 * \brief \c profile_labels holds the execution count of each label in the profile, \c profile_addresses that of each address.
+		 */
+		map <string, uint64_t> profile_labels;
+		map <uint64_t, uint64_t> profile_addresses;
+		/**
+		 * \brief \c fusion_pairs is the instruction pairs the fusion pass brings together.
+		 * \details The defaults are the pairs most cores that fuse at all fuse: building a constant or an address,
+		 * a far jump, zero extension by two shifts and the scaled index of an indexed load.
+		 */
+		vector <fusion_pair> fusion_pairs = {
+			{isaId("lui"), isaId("addi")}, {isaId("lui"), isaId("addiw")}, {isaId("auipc"), isaId("addi")}, {isaId("auipc"), isaId("jalr")},
+			{isaId("slli"), isaId("srli")}, {isaId("slli"), isaId("add")}
+		};
+		
+		
+		void error(string);
+		bool nextToken(stringstream&, string&);
+		void getOperand(stringstream&, string&);
+		bool getListOperand(stringstream&, string&);
+		void getImmediate(string, parsed_instruction&);
+		uint32_t getMemoryOperand(stringstream&, parsed_instruction&);
+		template <int64_t LOW, int64_t HIGH>
+		int64_t checkImmediate(int64_t);
+		void checkFormatImmediate(const parsed_instruction&);
+		uint32_t getRegister(string, uint8_t = 0);
+		uint32_t getVectorRegister(string);
+		void getVectorMask(stringstream&, parsed_instruction&, bool);
+		int64_t getVectorType(stringstream&);
+		uint32_t getFloatRegister(string);
+		int64_t getCsr(string);
+		void getRoundingMode(stringstream&, parsed_instruction&, bool);
+		uint32_t getOpcodeId(string, uint32_t&);
+		uint32_t getAddressRegister(string);
+		int64_t getFenceSet(string);
+		void makeLabel(string);
+		uint64_t findLabelPos(string);
+		void addItem(parsed_instruction&);
+		void selectSection(string);
+		void getArguments(stringstream&, vector <string>&, vector <uint64_t>&);
+		string getString(string);
+		void addData(const vector <string>&, const vector <uint64_t>&, uint64_t);
+		void addAlignment(const vector <string>&, const vector <uint64_t>&, bool);
+		void parseDirective(string, stringstream&);
+		void addInstruction(uint32_t, uint32_t, uint32_t, uint32_t, int64_t);
+		void expandSelect(stringstream&);
+		void baseConstantSequence(int64_t, vector <constant_step>&);
+		void constantSequence(int64_t, vector <constant_step>&);
+		void expandLi(stringstream&);
+		void expandCall(stringstream&, uint32_t);
+		bool parsePseudo(const string&, stringstream&);
+		bool parseLine(string);
+		bool compressInstruction(const parsed_instruction&, uint16_t&);
+		void resolveLabels();
+		void rebuildProgram(const vector <uint64_t>&);
+		uint64_t reachBound(const parsed_instruction&);
+		void fixedSections(const string&, vector <bool>&);
+		void peepholeProgram();
+		uint64_t scheduleBlock(const vector <uint64_t>&, vector <uint64_t>&);
+		void scheduleProgram();
+		bool fusesWith(const parsed_instruction&, const parsed_instruction&);
+		void fuseProgram();
+		void outlineProgram();
+		void alignBranchTargets();
+		bool findBlocks(uint32_t, vector <code_block>&);
+		void placeBlocks(vector <code_block>&, const vector <uint32_t>&, uint32_t, uint32_t, vector <uint64_t>&);
+		void profileCounts(vector <code_block>&);
+		void estimateCounts(vector <code_block>&);
+		uint32_t markCold(vector <code_block>&);
+		void chainBlocks(const vector <code_block>&, vector <uint32_t>&);
+		void layoutBlocks();
+		void layoutProgram();
+		bool fitsShortForm(const parsed_instruction&);
+		uint32_t expandRelaxed(const parsed_instruction&, parsed_instruction *);
+		void writeItem(FILE *, const parsed_instruction&, const uint32_t *);
+	public:
+		/**
+		 * \brief Default constructor.
+		 */
+		risc_v_assembler() {}
+		/**
+		 * \brief Constructor with file names.
+		 * 
+		 * \param [in] input_file_name is the name of the input file.
+		 * \param [in] output_file_name is the name of the output file.
+		 */
+		risc_v_assembler(char * input_file_name, char * output_file_name) {
+			input_file = input_file_name;
+			output_file = output_file_name;
+		}
+		
+		void process();
+		char * getInputFile();
+		char * getOutputFile();
+		void setInputFile(char * );
+		void setOutputFile(char * );
+		const vector <diagnostic> & getDiagnostics();
+		bool getCompress();
+		void setCompress(bool);
+		void setExtension(optional_extension, bool);
+		void setOptimization(optimization_pass, bool);
+		void setLatency(latency_class, uint32_t);
+		void clearFusionPairs();
+		bool addFusionPair(const string&, const string&);
+		void setFetchBlock(uint64_t, uint64_t);
+		bool loadProfile(const char *);
+		
+};
+
+/**
+ * \brief \c getRegister() is a function that interprets strings and gives the corresponding register out.
+ * 
+ * \param [in] input is a string to be interpreted as a register.
+ * \param [in] offset is the logical shift left amount for the output. 
+ * \return the register number 0-31
+ * 
+ * \details This function will error out if an unknown register is entered.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getRegister(string input, uint8_t offset) {
+	uint32_t numeric_part = 0;
+	string non_numeric_part = "";
+	
+	if (input.size() > 4) {
+		error("invalid register name \"" + input + "\"");
+	}
+	
+	for (int i = 0; i < input.size(); i++) {
+		if ((input.at(i) <= '9') && (input.at(i) >= '0')) {
+			numeric_part += ((input.at(i) - '0') * (input.size() - i - 1) * 10) + ((input.at(i) - '0') * (i == input.size() - 1));
+		} else {
+			non_numeric_part += input.at(i);
+		}
+	}
+	
+	if ((non_numeric_part.compare("x") == 0) && (numeric_part < 32)){
+		return numeric_part << offset;
+	} else if ((non_numeric_part.compare("t") == 0) && (numeric_part < 7)){
+		if (numeric_part < 3) {
+			return (5 + numeric_part) << offset;
+		} else {
+			return (25 + numeric_part) << offset;
+		}
+	} else if ((non_numeric_part.compare("s") == 0) && (numeric_part < 12)){
+		if (numeric_part < 2) {
+			return (8 + numeric_part) << offset;
+		} else {
+			return (16 + numeric_part) << offset;
+		}
+	} else if ((non_numeric_part.compare("a") == 0) && (numeric_part < 8)){
+		return (10 + numeric_part) << offset;
+	} else if ((non_numeric_part.compare("ra") == 0) && (input.size() == 2)) {
+		return (1) << offset;
+	} else if ((non_numeric_part.compare("sp") == 0) && (input.size() == 2)) {
+		return (2) << offset;
+	} else if ((non_numeric_part.compare("gp") == 0) && (input.size() == 2)) {
+		return (3) << offset;
+	} else if ((non_numeric_part.compare("tp") == 0) && (input.size() == 2)) {
+		return (4) << offset;
+	} else if ((non_numeric_part.compare("fp") == 0) && (input.size() == 2)) {
+		return (8) << offset;
+	} else if ((non_numeric_part.compare("zero") == 0) && (input.size() == 4)) {
+		return (0) << offset;
+	}
+	
+	error("invalid register name \"" + input + "\"");
+	
+	return 0;
+}
+
+/**
+ * \brief \c getVectorRegister() interprets a string as a vector register, \c v0 to \c v31.
+ *
+ * \param [in] input is the string to be interpreted.
+ * \returns The register number.
+ *
+ * \details This function will error out if the register is invalid.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getVectorRegister(string input) {
+	size_t end = 0;
+	uint32_t number = 32;
+
+	if ((input.size() >= 2) && (input.size() <= 3) && (input.at(0) == 'v') && isdigit((unsigned char)input.at(1)) && ((input.size() == 2) || (input.at(1) != '0'))) {
+		number = stoul(input.substr(1), &end);
+	}
+	if ((number > 31) || (end != input.size() - 1)) {
+		error("invalid vector register name \"" + input + "\"");
+	}
+	return number;
+}
+
+/**
+ * \brief \c getVectorMask() reads the optional \c v0.t mask operand that ends a vector instruction.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [in,out] instruction is the instruction, which has its mask bit set in \c flags if it is not masked.
+ * \param [in] more is \c true if the operand before ended in a comma.
+ *
+ * \details Instructions whose mask bit is fixed by \c isa_table take no mask operand.
+ * This function will error out if the operand is anything other than \c v0.t, or if a masked instruction would overwrite \c v0 with a vector.
+ * Stores read \c vd, the compares write a mask and the reductions write a single element, so they may name \c v0 when masked.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::getVectorMask(stringstream &ss_input, parsed_instruction &instruction, bool more) {
+	string temp;
+
+	if ((isa_table[instruction.op].mask & (1u << 25)) != 0) {
+		if (more) {
+			getOperand(ss_input, temp);
+			error("unexpected operand \"" + temp + "\"");
+		}
+		return;
+	}
+
+	if (!more) {
+		instruction.flags |= 1u << 25;
+		return;
+	}
+	getOperand(ss_input, temp);
+	if (temp.compare("v0.t") != 0) {
+		error("expected \"v0.t\", not \"" + temp + "\"");
+	}
+	const string mnemonic = isa_table[instruction.op].mnemonic;
+	if ((instruction.rd == 0) && ((isa_table[instruction.op].match & 0x7f) != 0x27) && (mnemonic.compare(0, 3, "vms") != 0)
+			&& (mnemonic.compare(0, 4, "vred") != 0)) {
+		error("masked instruction cannot write v0, it holds the mask");
+	}
+}
+
+/**
+ * \brief \c getVectorType() reads the \c vtype operands of \c vsetvli and \c vsetivli.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \returns The \c vtype immediate.
+ *
+ * \details The element width comes first and is the only one that must be given, as in \c e32, \c m2, \c ta, \c ma.
+ * The grouping defaults to \c m1 and the policies to \c tu and \c mu.
+ * This function will error out if an operand is unknown or out of order.
+ */
+template <unsigned XLEN>
+int64_t risc_v_assembler<XLEN>::getVectorType(stringstream &ss_input) {
+	static const char * const sew_names[] = {"e8", "e16", "e32", "e64"};
+	static const char * const lmul_names[] = {"m1", "m2", "m4", "m8", "", "mf8", "mf4", "mf2"};
+	static const char * const policy_names[] = {"tu", "ta", "mu", "ma"};
+	string temp;
+	int64_t vtype = 0;
+	unsigned field = 0;
+	bool more = true;
+
+	while (more) {
+		more = getListOperand(ss_input, temp);
+
+		bool found = false;
+		for (; (field < 4) && !found; field++) {
+			const char * const * names = (field == 0) ? sew_names : (field == 1) ? lmul_names : (policy_names + 2 * (field - 2));
+			const unsigned count = (field == 0) ? 4 : (field == 1) ? 8 : 2;
+			for (unsigned i = 0; (i < count) && !found; i++) {
+				if ((names[i][0] != '\0') && (temp.compare(names[i]) == 0)) {
+					vtype |= (field == 0) ? (i << 3) : (field == 1) ? i : (i << (4 + field));
+					found = true;
+				}
+			}
+			if (!found && (field == 0)) {
+				error("expected an element width such as \"e32\", not \"" + temp + "\"");
+			}
+		}
+		if (!found) {
+			error("unknown or misplaced vtype operand \"" + temp + "\"");
+		}
+	}
+	return vtype;
+}
+
+/**
+ * \brief \c getFloatRegister() interprets a string as a floating point register, \c f0 to \c f31 or its ABI name.
+ *
+ * \param [in] input is the string to be interpreted.
+ * \returns The register number.
+ *
+ * \details The ABI names are \c ft0 to \c ft11, \c fs0 to \c fs11 and \c fa0 to \c fa7.
+ * This function will error out if the register is invalid.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getFloatRegister(string input) {
+	static const struct {
+		const char * prefix;
+		uint32_t count;
+		uint8_t first[2];
+		uint32_t split;
+	} names[] = {{"f", 32, {0, 0}, 32}, {"ft", 12, {0, 20}, 8}, {"fs", 12, {8, 16}, 2}, {"fa", 8, {10, 10}, 8}};
+
+	for (const auto &name : names) {
+		const size_t length = mnemonicLength(name.prefix);
+		if ((input.size() <= length) || (input.size() > length + 2) || (input.compare(0, length, name.prefix) != 0)) {
+			continue;
+		}
+		if (!isdigit((unsigned char)input.at(length)) || ((input.size() == length + 2) && (!isdigit((unsigned char)input.at(length + 1)) || (input.at(length) == '0')))) {
+			continue;
+		}
+		const uint32_t number = stoul(input.substr(length));
+		if (number < name.count) {
+			return name.first[number >= name.split] + number;
+		}
+	}
+
+	error("invalid floating point register name \"" + input + "\"");
+	return 0;
+}
+
+/**
+ * \brief \c getRoundingMode() reads the optional rounding mode that ends a floating point instruction.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [in,out] instruction is the instruction, which has the rounding mode set in the \c funct3 bits of \c flags.
+ * \param [in] more is \c true if the operand before ended in a comma.
+ *
+ * \details The rounding mode is one of \c rne, \c rtz, \c rdn, \c rup, \c rmm or \c dyn, and is \c dyn if it is left out.
+ * Instructions whose \c funct3 is fixed by \c isa_table take no rounding mode.
+ * This function will error out if the rounding mode is unknown.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::getRoundingMode(stringstream &ss_input, parsed_instruction &instruction, bool more) {
+	static const char * const modes[] = {"rne", "rtz", "rdn", "rup", "rmm", "", "", "dyn"};
+	string temp;
+
+	if ((isa_table[instruction.op].mask & 0x00007000) != 0) {
+		if (more) {
+			getOperand(ss_input, temp);
+			error("unexpected operand \"" + temp + "\"");
+		}
+		return;
+	}
+
+	uint32_t mode = 7;
+	if (more) {
+		getOperand(ss_input, temp);
+		for (mode = 0; (mode < 8) && ((modes[mode][0] == '\0') || (temp.compare(modes[mode]) != 0)); mode++);
+		if (mode == 8) {
+			error("unknown rounding mode \"" + temp + "\"");
+		}
+	}
+	instruction.flags |= mode << 12;
+}
+
+/**
+ * \brief \c getCsr() interprets a string as a control and status register, by name or by number.
+ *
+ * \param [in] input is the string to be interpreted.
+ * \returns The CSR number.
+ *
+ * \details The names are looked up in \c csr_names, so finding one takes the same time however many there are.
+ * This function will error out if the string is neither a name nor a number.
+ */
+template <unsigned XLEN>
+int64_t risc_v_assembler<XLEN>::getCsr(string input) {
+	const int32_t id = csr_names<XLEN>.find(input);
+	if (id >= 0) {
+		return csr_table[id].number;
+	}
+
+	parsed_instruction csr;
+	getImmediate(input, csr);
+	if (csr.label.size() != 0) {
+		error("unknown CSR \"" + input + "\"");
+	}
+	return csr.imm;
+}
+
+/**
+ * \brief \c makeLabel() adds a label to branch/jump to. 
+ * 
+ * \param [in] name is the name of the branch.
+ *
+ * \details The label is added to the current section as an \c ITEM_LABEL, so it names the address of whatever comes next in that section.
+ * This function will error out if the label has already been defined.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::makeLabel(string name) {
+	if (labels.find(name) != labels.end()) {
+		error("label \"" + name + "\" is already defined");
+	}
+
+	parsed_instruction label;
+	label.kind = ITEM_LABEL;
+	label.size = 0;
+	addItem(label);
+	labels[name] = label.pos;
+}
+
+/**
+ * \brief \c findLabelPos() gets the location of the label that was branched/jumped to. 
+ * 
+ * \param [in] name is the name of the branch.
+ * \returns The location of the label.
+ * 
+ * \details This function will error out if an unknown label is entered.
+ */
+template <unsigned XLEN>
+uint64_t risc_v_assembler<XLEN>::findLabelPos(string name) {
+	map<string, uint64_t>::iterator it = labels.find(name);
+	if (it == labels.end()) {
+		error("undefined label \"" + name + "\"");
+	}
+	return labels[name];
+}
+
+/**
+ * \brief \c addItem() adds an instruction, label or data directive to the end of the current section.
+ *
+ * \param [in,out] item is the item, which has its \c pos, \c section and \c line filled in.
+ *
+ * \details This function will error out if the item has contents and the section is a \c .bss section.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::addItem(parsed_instruction &item) {
+	if (sections[current_section].nobits && (item.kind != ITEM_LABEL) && (item.kind != ITEM_ALIGN) && ((item.kind != ITEM_FILL) || (item.fill != 0))) {
+		error("\"" + sections[current_section].name + "\" can only hold zeros");
+	}
+
+	item.pos = program.size();
+	item.section = current_section;
+	item.line = current_line;
+	program.push_back(item);
+}
+
+/**
+ * \brief \c selectSection() makes a section the current one, adding it on first use.
+ *
+ * \param [in] name is the name of the section.
+ *
+ * \details Sections whose names start with \c .text hold code and those starting with \c .bss hold no contents.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::selectSection(string name) {
+	for (current_section = 0; current_section < sections.size(); current_section++) {
+		if (sections[current_section].name.compare(name) == 0) {
+			return;
+		}
+	}
+
+	program_section section;
+	section.name = name;
+	section.code = (name.compare(0, 5, ".text") == 0);
+	section.nobits = (name.compare(0, 4, ".bss") == 0) || (name.compare(0, 5, ".sbss") == 0);
+	if (section.code) {
+		section.alignment = 4;
+	}
+	sections.push_back(section);
+}
+
+/**
+ * \brief \c error() abandons the line currently being assembled.
+ *
+ * \param [in] message describes what went wrong.
+ *
+ * \details The error is recorded by \c process() against \c current_line and \c current_column, and assembly continues on the next line.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::error(string message) {
+	throw assembly_error(message);
+}
+
+/**
+ * \brief \c nextToken() reads the next whitespace separated token from a line and remembers its column.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [out] token is the token that was read.
+ * \returns \c true if a token was read that is not the start of a comment.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::nextToken(stringstream &ss_input, string &token) {
+	ss_input >> ws;
+	streampos position = ss_input.tellg();
+	if (position == streampos(-1)) {
+		current_column = ss_input.str().size() + 1;
+	} else {
+		current_column = (uint64_t)position + 1;
+	}
+
+	token.clear();
+	ss_input >> token;
+	return ss_input && (token.size() != 0) && (token.at(0) != '#');
+}
+
+/**
+ * \brief \c getOperand() reads the next operand of an instruction.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [out] token is the operand that was read.
+ *
+ * \details This function will error out if the line has run out of operands.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::getOperand(stringstream &ss_input, string &token) {
+	if (!nextToken(ss_input, token)) {
+		error("missing operand");
+	}
+}
+
+/**
+ * \brief \c getListOperand() reads the next operand of an instruction whose last operands may be left out.
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [out] token is the operand that was read, without its trailing comma.
+ * \returns \c true if the operand ended in a comma, so another operand follows.
+ *
+ * \details This function will error out if the line has run out of operands.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::getListOperand(stringstream &ss_input, string &token) {
+	getOperand(ss_input, token);
+	if (token.at(token.size() - 1) != ',') {
+		return false;
+	}
+	token.pop_back();
+	return true;
+}
+
+/**
+ * \brief \c getImmediate() interprets a string as a hex, decimal or label immediate.
+ *
+ * \param [in] input is the string to be interpreted.
+ * \param [out] instruction receives the value in \c imm, or the label name in \c label to be resolved once every label is known.
+ *
+ * \details This function will error out if the immediate can not be read.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::getImmediate(string input, parsed_instruction &instruction) {
+	size_t end = 0;
+
+	if (input.size() == 0) {
+		error("missing immediate");
+	}
+
+	try {
+		if ((input.size() >= 2) && (input.at(0) == '0') && (input.at(1) == 'x')) {
+			instruction.imm = (int64_t)stoull(input, &end, 16);
+		} else if (((input.at(0) <= '9') && (input.at(0) >= '0')) || (input.at(0) == '-')) {
+			instruction.imm = stoll(input, &end);
+		} else {
+			instruction.label = input;
+			instruction.column = current_column;
+			return;
+		}
+	} catch (const logic_error &) {
+		error("invalid immediate \"" + input + "\"");
+	}
+
+	if (end != input.size()) {
+		error("invalid immediate \"" + input + "\"");
+	}
+}
+
+/**
+ * \brief \c getMemoryOperand() reads a load or store address written as \c offset(register).
+ *
+ * \param [in,out] ss_input is the line being read.
+ * \param [out] instruction receives the offset in front of the brackets.
+ * \returns The base register number.
+ *
+ * \details This function will error out if the operand is malformed.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getMemoryOperand(stringstream &ss_input, parsed_instruction &instruction) {
+	string temp = "";
+	string temp_2 = "";
+	char temp_c = 0;
+
+	ss_input.get();
+	current_column = (uint64_t)ss_input.tellg() + 1;
+	temp_c = ss_input.get();
+	while (temp_c != '(' && ss_input) {
+		temp_2 += temp_c;
+		temp_c = ss_input.get();
+	}
+	if (!ss_input) {
+		error("expected \"offset(register)\"");
+	}
+	if (temp_2.find_first_not_of(" \t") == string::npos) {
+		instruction.imm = 0;
+	} else {
+		getImmediate(temp_2, instruction);
+	}
+
+	getOperand(ss_input, temp);
+	return getRegister(temp.substr(0, (temp.size() - 1)));
+}
+
+/**
+ * \brief \c checkImmediate() makes sure an immediate fits in its field.
+ *
+ * \tparam LOW is the smallest value the field can hold.
+ * \tparam HIGH is the largest value the field can hold.
+ * \param [in] value is the immediate to be checked.
+ * \returns \c value
+ *
+ * \details This function will error out if the immediate is out of range.
+ */
+template <unsigned XLEN>
+template <int64_t LOW, int64_t HIGH>
+int64_t risc_v_assembler<XLEN>::checkImmediate(int64_t value) {
+	if ((value < LOW) || (value > HIGH)) {
+		error("immediate " + to_string(value) + " out of range [" + to_string(LOW) + ", " + to_string(HIGH) + "]");
+	}
+	return value;
+}
+
+/**
+ * \brief \c checkFormatImmediate() makes sure the immediate of an instruction fits in the field of its format.
+ *
+ * \param [in] instruction is the instruction to be checked.
+ *
+ * \details Shift amounts are told apart from 12 bit immediates by the mask of the instruction,
+ * which fixes the bits above a 5 or 6 bit shift amount, and the vector shifts take an unsigned 5 bit amount.
+ * In the same way a load whose mask fixes the immediate (\c cbo.*) must have a 0 offset,
+ * and a store whose mask fixes the low 5 offset bits (\c prefetch.*) must have an offset that is a multiple of 32.
+ * This function will error out if the immediate is out of range.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::checkFormatImmediate(const parsed_instruction &instruction) {
+	const uint32_t mask = isa_table[instruction.op].mask;
+
+	switch (isa_table[instruction.op].format) {
+		case 'I':
+			if (mask == 0xfc00707f) {
+				checkImmediate<0, (1 << xlen_traits<XLEN>::shamt_bits) - 1>(instruction.imm);
+			} else if (mask == 0xfe00707f) {
+				checkImmediate<0, 31>(instruction.imm);
+			} else {
+				checkImmediate<signedMin(format_layout<'I'>::imm_bits), signedMax(format_layout<'I'>::imm_bits)>(instruction.imm);
+			}
+		break;
+		case 'L':
+		case 'l':
+			if ((mask & 0xfff00000) != 0) {
+				checkImmediate<0, 0>(instruction.imm);
+			} else {
+				checkImmediate<signedMin(format_layout<'L'>::imm_bits), signedMax(format_layout<'L'>::imm_bits)>(instruction.imm);
+			}
+		break;
+		case 'S':
+		case 's':
+			if ((mask & 0x00000f80) != 0) {
+				checkImmediate<signedMin(format_layout<'S'>::imm_bits), signedMax(format_layout<'S'>::imm_bits)>(instruction.imm);
+				if ((instruction.imm & 31) != 0) {
+					error("offset " + to_string(instruction.imm) + " is not a multiple of 32");
+				}
+			} else {
+				checkImmediate<signedMin(format_layout<'S'>::imm_bits), signedMax(format_layout<'S'>::imm_bits)>(instruction.imm);
+			}
+		break;
+		case 'C':
+		case 'W':
+			checkImmediate<0, 0xfff>(instruction.imm);
+		break;
+		case 'U':
+			checkImmediate<signedMin(format_layout<'U'>::imm_bits), 0xfffff>(instruction.imm);
+		break;
+		case 'J':
+			checkImmediate<signedMin(format_layout<'J'>::imm_bits), signedMax(format_layout<'J'>::imm_bits)>(instruction.imm);
+		break;
+		case 'Y':
+			if ((mask == 0xfc00707f) && (((isa_table[instruction.op].match >> 26) == 0x25) || ((isa_table[instruction.op].match >> 27) == 0x14))) {
+				checkImmediate<0, 31>(instruction.imm);
+			} else {
+				checkImmediate<signedMin(format_layout<'Y'>::imm_bits), signedMax(format_layout<'Y'>::imm_bits)>(instruction.imm);
+			}
+		break;
+		case 'B':
+			checkImmediate<signedMin(format_layout<'B'>::imm_bits), signedMax(format_layout<'B'>::imm_bits)>(instruction.imm);
+		break;
+	}
+}
+
+/**
+ * \brief \c getOpcodeId() looks an instruction up in the perfect hash generated from riscv_opcodes.def.
+ *
+ * \param [in] input is the instruction to be looked up.
+ * \param [out] flags receives the \c aq and \c rl bits of an atomic instruction's ordering suffix.
+ * \returns The opcode id, the index into \c isa_table.
+ *
+ * \details The \c .aq, \c .rl and \c .aqrl suffixes of the atomic instructions are not in the table.
+ * They are only looked for when a mnemonic is not found, and cost one more lookup of the mnemonic without them.
+ * This function will error out if an unknown opcode is entered, which includes the instructions of the other \c XLEN.
+ * \note riscv_opcodes.def is the file that needs to be edited to add more instructions.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getOpcodeId(string input, uint32_t &flags) {
+	static const struct {
+		const char * suffix;
+		size_t length;
+		uint32_t bits;
+	} orderings[] = {{".aqrl", 5, 3u << 25}, {".aq", 3, 1u << 26}, {".rl", 3, 1u << 25}};
+
+	int32_t id = mnemonic_table<XLEN>.find(input);
+	for (size_t i = 0; (id < 0) && (i < 3); i++) {
+		if ((input.size() > orderings[i].length) && (input.compare(input.size() - orderings[i].length, orderings[i].length, orderings[i].suffix) == 0)) {
+			id = mnemonic_table<XLEN>.find(input.substr(0, input.size() - orderings[i].length));
+			if ((id >= 0) && (isa_table[id].format == 'A')) {
+				flags |= orderings[i].bits;
+			} else {
+				id = -1;
+			}
+			break;
+		}
+	}
+	if (id < 0) {
+		error("unrecognized command \"" + input + "\" for " + xlen_traits<XLEN>::name);
+	}
+	return id;
+}
+
+/**
+ * \brief \c getAddressRegister() reads the address of an atomic or vector memory instruction, written as \c (register) or \c 0(register).
+ *
+ * \param [in] input is the operand.
+ * \returns The register number.
+ *
+ * \details This function will error out if the operand is malformed.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::getAddressRegister(string input) {
+	if ((input.size() >= 1) && (input.at(0) == '0')) {
+		input.erase(0, 1);
+	}
+	if ((input.size() < 3) || (input.at(0) != '(') || (input.at(input.size() - 1) != ')')) {
+		error("expected \"(register)\"");
+	}
+	return getRegister(input.substr(1, (input.size() - 2)));
+}
+
+/**
+ * \brief \c getFenceSet() reads the predecessor or successor set of a \c fence.
+ *
+ * \param [in] input is the set, some of \c i, \c o, \c r and \c w in that order.
+ * \returns The 4 bit set.
+ *
+ * \details This function will error out if the set is malformed.
+ */
+template <unsigned XLEN>
+int64_t risc_v_assembler<XLEN>::getFenceSet(string input) {
+	static const char order[] = "iorw";
+	int64_t set = 0;
+	size_t next = 0;
+
+	for (char c : input) {
+		while ((next < 4) && (order[next] != c)) {
+			next++;
+		}
+		if (next == 4) {
+			error("invalid fence set \"" + input + "\"");
+		}
+		set |= 8 >> next++;
+	}
+	if (set == 0) {
+		error("invalid fence set \"" + input + "\"");
+	}
+	return set;
+}
+
+/**
+ * \brief \c getArguments() reads the comma separated arguments of a directive, up to the end of the line or a comment.
+ *
+ * \param [in,out] ss_input is the line being read, which is left empty.
+ * \param [out] arguments receives each argument with the space around it removed.
+ * \param [out] columns receives the column each argument starts at, for diagnostics.
+ *
+ * \details Commas and \c # inside double quoted strings do not end an argument.
+ * This function will error out if an argument is missing between two commas.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::getArguments(stringstream &ss_input, vector <string> &arguments, vector <uint64_t> &columns) {
+	const string line = ss_input.str();
+	streampos position = ss_input.tellg();
+	size_t i = (position == streampos(-1)) ? line.size() : (size_t)position;
+	string argument = "";
+	bool quoted = false;
+
+	arguments.clear();
+	columns.clear();
+	ss_input.seekg(0, ios::end);
+
+	for (; i <= line.size(); i++) {
+		const char c = (i < line.size()) ? line.at(i) : '\0';
+
+		if (quoted) {
+			argument += c;
+			if ((c == '\\') && (i + 1 < line.size())) {
+				argument += line.at(++i);
+			} else if (c == '"') {
+				quoted = false;
+			}
+		} else if ((c == ',') || (c == '#') || (c == '\0')) {
+			while ((argument.size() != 0) && isspace((unsigned char)argument.back())) {
+				argument.pop_back();
+			}
+			if ((argument.size() == 0) && ((c == ',') || (arguments.size() != 0))) {
+				current_column = i + 1;
+				error("missing operand");
+			}
+			if (argument.size() != 0) {
+				arguments.push_back(argument);
+			}
+			if (c != ',') {
+				break;
+			}
+			argument.clear();
+		} else if ((argument.size() != 0) || !isspace((unsigned char)c)) {
+			if (argument.size() == 0) {
+				columns.push_back(i + 1);
+			}
+			argument += c;
+			quoted = (c == '"');
+		}
+	}
+
+	if (quoted) {
+		current_column = columns.back();
+		error("unterminated string");
+	}
+}
+
+/**
+ * \brief \c getString() reads a double quoted string, with C style escapes.
+ *
+ * \param [in] input is the argument, including its quotes.
+ * \returns The characters of the string.
+ *
+ * \details This function will error out if the string is malformed.
+ */
+template <unsigned XLEN>
+string risc_v_assembler<XLEN>::getString(string input) {
+	string output = "";
+
+	if ((input.size() < 2) || (input.at(0) != '"') || (input.at(input.size() - 1) != '"')) {
+		error("expected a string in double quotes");
+	}
+
+	for (size_t i = 1; i < input.size() - 1; i++) {
+		if (input.at(i) != '\\') {
+			output += input.at(i);
+			continue;
+		}
+		if (++i == input.size() - 1) {
+			error("invalid escape at the end of \"" + input + "\"");
+		}
+		switch (input.at(i)) {
+			case 'n':  output += '\n'; break;
+			case 't':  output += '\t'; break;
+			case 'r':  output += '\r'; break;
+			case '0':  output += '\0'; break;
+			case '\\': output += '\\'; break;
+			case '"':  output += '"';  break;
+			case '\'': output += '\''; break;
+			case 'x': {
+				size_t end = i + 1;
+				while ((end < input.size() - 1) && (end < i + 3) && isxdigit((unsigned char)input.at(end))) {
+					end++;
+				}
+				if (end == i + 1) {
+					error("invalid escape in \"" + input + "\"");
+				}
+				output += (char)stoul(input.substr(i + 1, end - i - 1), nullptr, 16);
+				i = end - 1;
+			} break;
+			default:
+				error(string("invalid escape \"\\") + input.at(i) + "\"");
+		}
+	}
+	return output;
+}
+
+/**
+ * \brief \c addData() adds the values of a \c .byte, \c .half, \c .word or \c .dword directive.
+ *
+ * \param [in] arguments are the values, numbers or labels.
+ * \param [in] columns are the columns of the values.
+ * \param [in] width is the number of bytes in each value.
+ *
+ * \details A label gives the address it names. This function will error out if a number does not fit in \c width bytes.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::addData(const vector <string> &arguments, const vector <uint64_t> &columns, uint64_t width) {
+	for (size_t i = 0; i < arguments.size(); i++) {
+		parsed_instruction data;
+		data.kind = ITEM_DATA;
+		data.size = width;
+		current_column = columns[i];
+		getImmediate(arguments[i], data);
+		if ((width < 8) && (data.label.size() == 0) && ((data.imm < signedMin(8 * width)) || (data.imm > (int64_t)fieldMask(8 * width)))) {
+			error("value " + to_string(data.imm) + " does not fit in " + to_string(width) + " byte(s)");
+		}
+		addItem(data);
+	}
+}
+
+/**
+ * \brief \c addAlignment() adds the padding for a \c .align, \c .p2align or \c .balign directive.
+ *
+ * \param [in] arguments are the alignment, then optionally the fill byte and the most bytes that may be skipped.
+ * \param [in] columns are the columns of the arguments.
+ * \param [in] power_of_two is true if the alignment is given as a power of two rather than a number of bytes.
+ *
+ * \details The padding is made of nops in a code section unless a fill byte is given, with a \c c.nop wherever compressed code left it
+ * 2 bytes past a multiple of 4, even if \c .option \c norvc came in between.
+ * This function will error out if the alignment is not a power of two or is too large.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::addAlignment(const vector <string> &arguments, const vector <uint64_t> &columns, bool power_of_two) {
+	parsed_instruction padding;
+	padding.kind = ITEM_ALIGN;
+	padding.size = 0;
+
+	if ((arguments.size() == 0) || (arguments.size() > 3)) {
+		error("expected \"alignment[, fill[, limit]]\"");
+	}
+	for (size_t i = 0; i < arguments.size(); i++) {
+		parsed_instruction value;
+		current_column = columns[i];
+		getImmediate(arguments[i], value);
+		if ((value.label.size() != 0) || (value.imm < 0)) {
+			error("invalid alignment operand \"" + arguments[i] + "\"");
+		}
+		if (i == 0) {
+			if (power_of_two && (value.imm > 16)) {
+				error("alignment 2^" + to_string(value.imm) + " is too large");
+			} else if (!power_of_two && ((value.imm > (1 << 16)) || ((value.imm & (value.imm - 1)) != 0))) {
+				error("alignment " + to_string(value.imm) + " is not a power of two up to 65536");
+			}
+			padding.imm = power_of_two ? (INT64_C(1) << value.imm) : max(value.imm, INT64_C(1));
+		} else if (i == 1) {
+			padding.fill = (int16_t)(value.imm & 0xff);
+		} else {
+			padding.limit = value.imm;
+		}
+	}
+
+	sections[current_section].alignment = max(sections[current_section].alignment, (uint64_t)padding.imm);
+	addItem(padding);
+}
+
+/**
+ * \brief \c parseDirective() carries out an assembler directive.
+ *
+ * \param [in] name is the directive, including its leading dot.
+ * \param [in,out] ss_input is the rest of the line.
+ *
+ * \details The directives understood are:
+ * - \c .text, \c .data, \c .rodata, \c .bss and \c .section \c name, which pick the section that follows.
+ * - \c .align and \c .p2align, which pad to a power of two, and \c .balign, which pads to a number of bytes.
+ * - \c .byte, \c .half, \c .word and \c .dword (and their \c .2byte, \c .4byte and \c .8byte spellings), which add values.
+ * - \c .ascii, and \c .asciz or \c .string which add a terminating zero.
+ * - \c .zero and \c .space, which add a number of fill bytes.
+ * - \c .option \c rvc and \c .option \c norvc, which turn instruction compression on and off.
+ * - \c .option \c arch, \c +ext or \c -ext, which say if the target has \c c, \c zba or \c zbb, for the sequences pseudo-instructions pick.
+ * - \c .cold, which follows a label and marks the code it starts as rarely run, for \c OPTIMIZE_SPLIT_COLD. It is ignored if that pass is not run.
+ * - \c .globl, \c .global, \c .local, \c .type and \c .size, which are accepted and ignored.
+ *
+ * This function will error out on anything else.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::parseDirective(string name, stringstream &ss_input) {
+	string temp;
+	vector <string> arguments;
+	vector <uint64_t> columns;
+
+	if ((name.compare(".text") == 0) || (name.compare(".data") == 0) || (name.compare(".rodata") == 0) || (name.compare(".bss") == 0)) {
+		selectSection(name);
+	} else if (name.compare(".section") == 0) {
+		getArguments(ss_input, arguments, columns);
+		if (arguments.size() == 0) {
+			error("missing section name");
+		}
+		selectSection(arguments[0]);
+		if ((arguments.size() > 2) && (arguments[2].compare("@nobits") == 0)) {
+			sections[current_section].nobits = true;
+		}
+	} else if ((name.compare(".align") == 0) || (name.compare(".p2align") == 0) || (name.compare(".balign") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		addAlignment(arguments, columns, name.compare(".balign") != 0);
+	} else if (name.compare(".byte") == 0) {
+		getArguments(ss_input, arguments, columns);
+		addData(arguments, columns, 1);
+	} else if ((name.compare(".half") == 0) || (name.compare(".2byte") == 0) || (name.compare(".short") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		addData(arguments, columns, 2);
+	} else if ((name.compare(".word") == 0) || (name.compare(".4byte") == 0) || (name.compare(".long") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		addData(arguments, columns, 4);
+	} else if ((name.compare(".dword") == 0) || (name.compare(".8byte") == 0) || (name.compare(".quad") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		addData(arguments, columns, 8);
+	} else if ((name.compare(".ascii") == 0) || (name.compare(".asciz") == 0) || (name.compare(".string") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		for (size_t i = 0; i < arguments.size(); i++) {
+			current_column = columns[i];
+			parsed_instruction text;
+			text.kind = ITEM_STRING;
+			text.bytes = getString(arguments[i]);
+			if (name.compare(".ascii") != 0) {
+				text.bytes += '\0';
+			}
+			text.size = text.bytes.size();
+			addItem(text);
+		}
+	} else if ((name.compare(".zero") == 0) || (name.compare(".space") == 0)) {
+		getArguments(ss_input, arguments, columns);
+		if ((arguments.size() == 0) || (arguments.size() > 2)) {
+			error("expected \"size[, fill]\"");
+		}
+		parsed_instruction fill;
+		fill.kind = ITEM_FILL;
+		fill.fill = 0;
+		for (size_t i = 0; i < arguments.size(); i++) {
+			parsed_instruction value;
+			current_column = columns[i];
+			getImmediate(arguments[i], value);
+			if ((value.label.size() != 0) || (value.imm < 0)) {
+				error("invalid size \"" + arguments[i] + "\"");
+			}
+			if (i == 0) {
+				fill.size = value.imm;
+			} else {
+				fill.fill = (int16_t)(value.imm & 0xff);
+			}
+		}
+		addItem(fill);
+	} else if (name.compare(".option") == 0) {
+		getOperand(ss_input, temp);
+		if (temp.compare("rvc") == 0) {
+			rvc_active = true;
+		} else if (temp.compare("norvc") == 0) {
+			rvc_active = false;
+		} else if (temp.compare("arch,") == 0) {
+			getArguments(ss_input, arguments, columns);
+			if (arguments.size() == 0) {
+				error("missing extension");
+			}
+			for (size_t i = 0; i < arguments.size(); i++) {
+				current_column = columns[i];
+				const bool present = (arguments[i].at(0) == '+');
+				const string extension = arguments[i].substr(1);
+				if ((arguments[i].at(0) != '+') && (arguments[i].at(0) != '-')) {
+					error("expected \"+extension\" or \"-extension\"");
+				} else if (extension.compare("c") == 0) {
+					rvc_active = present;
+				} else if (extension.compare("zba") == 0) {
+					extensions_active = present ? (extensions_active | OPTIONAL_ZBA) : (extensions_active & ~(uint32_t)OPTIONAL_ZBA);
+				} else if (extension.compare("zbb") == 0) {
+					extensions_active = present ? (extensions_active | OPTIONAL_ZBB) : (extensions_active & ~(uint32_t)OPTIONAL_ZBB);
+				} else {
+					error("unknown extension \"" + extension + "\"");
+				}
+			}
+		} else {
+			error("unknown option \"" + temp + "\"");
+		}
+	} else if (name.compare(".cold") == 0) {
+		uint64_t last = program.size();
+		while ((last > 0) && (program[last - 1].section != current_section)) {
+			last--;
+		}
+		if (!sections[current_section].code) {
+			error("\".cold\" can only mark code");
+		}
+		if ((last == 0) || (program[last - 1].kind != ITEM_LABEL)) {
+			error("\".cold\" must follow a label");
+		}
+		program[last - 1].cold = true;
+	} else if ((name.compare(".globl") == 0) || (name.compare(".global") == 0) || (name.compare(".local") == 0) || (name.compare(".type") == 0) || (name.compare(".size") == 0)) {
+		getArguments(ss_input, arguments, columns);
+	} else {
+		error("unknown directive \"" + name + "\"");
+	}
+
+	if (nextToken(ss_input, temp)) {
+		error("unexpected operand \"" + temp + "\"");
+	}
+}
+
+/**
+ * \brief \c addInstruction() adds an instruction made up by the assembler, such as one of the sequence a pseudo-instruction stands for.
+ *
+ * \param [in] op is the opcode id.
+ * \param [in] rd is the destination register.
+ * \param [in] rs1 is the first source register.
+ * \param [in] rs2 is the second source register.
+ * \param [in] imm is the immediate.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::addInstruction(uint32_t op, uint32_t rd, uint32_t rs1, uint32_t rs2, int64_t imm) {
+	parsed_instruction instruction;
+	instruction.op = op;
+	instruction.rd = rd;
+	instruction.rs1 = rs1;
+	instruction.rs2 = rs2;
+	instruction.imm = imm;
+	instruction.compress = rvc_active;
+
+	checkFormatImmediate(instruction);
+	addItem(instruction);
+}
+
+/**
+ * \brief \c expandSelect() reads \c select \c rd, \c cond, \c a, \c b, which sets \c rd to \c a if \c cond is not zero and to \c b if it is.
+ *
+ * \param [in,out] ss_input is the line being read, just after the mnemonic.
+ *
+ * \details This is done without a branch using the Zicond instructions, as \c rd = \c b ^ \c czero.eqz(\c a ^ \c b, \c cond),
+ * or the other way around if \c rd is \c b, so no register other than \c rd is written.
+ * It is a single instruction if \c a or \c b is \c x0 or they are the same register.
+ * This function will error out if \c rd is \c cond and more than one instruction is needed.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::expandSelect(stringstream &ss_input) {
+	string temp;
+
+	if (!nextToken(ss_input, temp)) {
+		error("missing operand");
+	}
+	const uint32_t rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+	getOperand(ss_input, temp);
+	const uint32_t cond = getRegister(temp.substr(0, (temp.size() - 1)));
+
+	getOperand(ss_input, temp);
+	const uint32_t a = getRegister(temp.substr(0, (temp.size() - 1)));
+
+	getOperand(ss_input, temp);
+	const uint32_t b = getRegister(temp);
+
+	if (a == b) {
+		addInstruction(isaId("addi"), rd, a, 0, 0);
+	} else if (b == 0) {
+		addInstruction(isaId("czero.eqz"), rd, a, cond, 0);
+	} else if (a == 0) {
+		addInstruction(isaId("czero.nez"), rd, b, cond, 0);
+	} else if (rd == cond) {
+		error("select can not write the condition register when neither value is x0");
+	} else if (rd != b) {
+		addInstruction(isaId("xor"), rd, a, b, 0);
+		addInstruction(isaId("czero.eqz"), rd, rd, cond, 0);
+		addInstruction(isaId("xor"), rd, rd, b, 0);
+	} else {
+		addInstruction(isaId("xor"), rd, b, a, 0);
+		addInstruction(isaId("czero.nez"), rd, rd, cond, 0);
+		addInstruction(isaId("xor"), rd, rd, a, 0);
+	}
+}
+
+/**
+ * \brief \c baseConstantSequence() finds the \c lui, \c addi(w) and \c slli sequence for a constant.
+ *
+ * \param [in] value is the constant.
+ * \param [out] sequence has the instructions added to its end.
+ *
+ * \details A 32 bit constant is \c lui of its upper 20 bits, rounded so that the sign extended low 12 bits added by \c addi(w) carry into them.
+ * A wider one is the sequence for its upper bits with their trailing zeros dropped, shifted into place by \c slli,
+ * and then the low 12 bits added the same way.
+ * With Zba, upper bits that are a 32 bit unsigned number are built as if signed and shifted by \c slli.uw, which drops the sign extension.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::baseConstantSequence(int64_t value, vector <constant_step> &sequence) {
+	const int64_t low = signExtend(value, 12);
+
+	if (!xlen_traits<XLEN>::rv64 || ((value >= INT32_MIN) && (value <= INT32_MAX))) {
+		const int64_t high = (int64_t)((((uint64_t)value + 0x800) >> 12) & 0xfffff);
+		if (high != 0) {
+			sequence.push_back({isaId("lui"), high, false});
+		}
+		if ((low != 0) || (high == 0)) {
+			sequence.push_back({(xlen_traits<XLEN>::rv64 && (high != 0)) ? isaId("addiw") : isaId("addi"), low, false});
+		}
+		return;
+	}
+
+	const uint64_t high = ((uint64_t)value + 0x800) >> 12;
+	unsigned shift = 12 + __builtin_ctzll(high);
+	int64_t upper = signExtend((int64_t)(high >> (shift - 12)), 64 - shift);
+	bool zero_extend = false;
+
+	if ((shift > 12) && ((upper < signedMin(12)) || (upper > signedMax(12)))) {
+		const uint64_t lui_upper = (uint64_t)upper << 12;
+		if (signExtend((int64_t)lui_upper, 32) == (int64_t)lui_upper) {
+			shift -= 12;
+			upper = (int64_t)lui_upper;
+		} else if (((extensions_active & OPTIONAL_ZBA) != 0) && ((lui_upper >> 32) == 0)) {
+			shift -= 12;
+			upper = signExtend((int64_t)lui_upper, 32);
+			zero_extend = true;
+		}
+	}
+	if (((extensions_active & OPTIONAL_ZBA) != 0) && (((uint64_t)upper >> 32) == 0) && (upper > INT32_MAX)) {
+		upper = signExtend(upper, 32);
+		zero_extend = true;
+	}
+
+	baseConstantSequence(upper, sequence);
+	sequence.push_back({zero_extend ? isaId("slli.uw") : isaId("slli"), shift, false});
+	if (low != 0) {
+		sequence.push_back({isaId("addi"), low, false});
+	}
+}
+
+/**
+ * \brief \c constantSequence() finds the shortest sequence of instructions that builds a constant.
+ *
+ * \param [in] value is the constant.
+ * \param [out] sequence is set to the instructions.
+ *
+ * \details Starting from \c baseConstantSequence(), each candidate builds a related constant and finishes with one instruction:
+ * - \c slli, from the constant with some or all of its trailing zeros shifted out.
+ * - \c srli, from the constant with its leading zeros shifted out, and the bits shifted in either zeros or ones.
+ * - With Zba, \c zext.w (\c add.uw) or \c slli.uw from a 32 bit constant,
+ *   and \c sh1add, \c sh2add or \c sh3add of the register to itself, from a third, a fifth or a ninth of the constant.
+ * - With Zbb, \c rori from a rotation of the constant that is quicker to build.
+ * - \c addi of the low 12 bits, from the best sequence for the rest of the constant, whose low 12 bits are then zero so this only recurses once.
+ *
+ * The shortest wins, and on a tie the earlier one, so the base sequence is kept unless another is strictly shorter.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::constantSequence(int64_t value, vector <constant_step> &sequence) {
+	vector <constant_step> candidate;
+
+	sequence.clear();
+	baseConstantSequence(value, sequence);
+	if (!xlen_traits<XLEN>::rv64 || (sequence.size() <= 1)) {
+		return;
+	}
+
+	auto consider = [&](int64_t start, constant_step last) {
+		candidate.clear();
+		baseConstantSequence(start, candidate);
+		candidate.push_back(last);
+		if (candidate.size() < sequence.size()) {
+			sequence = candidate;
+		}
+	};
+
+	const uint64_t bits = (uint64_t)value;
+	if (bits != 0) {
+		const unsigned trailing = __builtin_ctzll(bits);
+		for (unsigned shift = trailing; shift > 0; shift--) {
+			consider(value >> shift, {isaId("slli"), shift, false});
+		}
+		const unsigned leading = __builtin_clzll(bits);
+		if (leading != 0) {
+			consider((int64_t)((bits << leading) | ((UINT64_C(1) << leading) - 1)), {isaId("srli"), leading, false});
+			consider((int64_t)(bits << leading), {isaId("srli"), leading, false});
+		}
+
+		if ((extensions_active & OPTIONAL_ZBA) != 0) {
+			if ((bits >> 32) == 0) {
+				consider(signExtend(value, 32), {isaId("add.uw"), 0, false});
+			}
+			for (unsigned shift = trailing; shift > 0; shift--) {
+				if (((bits >> shift) >> 32) == 0) {
+					consider(signExtend((int64_t)(bits >> shift), 32), {isaId("slli.uw"), shift, false});
+				}
+			}
+			const struct {
+				int64_t factor;
+				uint32_t op;
+			} multiples[] = {{3, isaId("sh1add")}, {5, isaId("sh2add")}, {9, isaId("sh3add")}};
+			for (const auto &multiple : multiples) {
+				if ((value % multiple.factor) == 0) {
+					consider(value / multiple.factor, {multiple.op, 0, true});
+				}
+			}
+		}
+
+		if ((extensions_active & OPTIONAL_ZBB) != 0) {
+			for (unsigned rotate = 1; (rotate < 64) && (sequence.size() > 2); rotate++) {
+				consider((int64_t)((bits << rotate) | (bits >> (64 - rotate))), {isaId("rori"), rotate, false});
+			}
+		}
+	}
+
+	const int64_t low = signExtend(value, 12);
+	if (low != 0) {
+		constantSequence((int64_t)(bits - low), candidate);
+		candidate.push_back({isaId("addi"), low, false});
+		if (candidate.size() < sequence.size()) {
+			sequence = candidate;
+		}
+	}
+}
+
+/**
+ * \brief \c expandLi() reads \c li \c rd, \c imm, which loads a constant into a register with the shortest sequence \c constantSequence() finds.
+ *
+ * \param [in,out] ss_input is the line being read, just after the mnemonic.
+ *
+ * \details On RV32 the constant may be written signed or unsigned.
+ * This function will error out if the constant is a label or does not fit in \c XLEN bits.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::expandLi(stringstream &ss_input) {
+	string temp;
+	parsed_instruction constant;
+	vector <constant_step> sequence;
+
+	if (!nextToken(ss_input, temp)) {
+		error("missing operand");
+	}
+	const uint32_t rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+	getOperand(ss_input, temp);
+	getImmediate(temp, constant);
+	if (constant.label.size() != 0) {
+		error("invalid immediate \"" + temp + "\"");
+	}
+	if (!xlen_traits<XLEN>::rv64) {
+		constant.imm = signExtend(checkImmediate<INT32_MIN, UINT32_MAX>(constant.imm), 32);
+	}
+
+	constantSequence(constant.imm, sequence);
+
+	uint32_t source = 0;
+	for (const constant_step &step : sequence) {
+		addInstruction(step.op, rd, source, step.twice ? source : 0, step.imm);
+		source = rd;
+	}
+}
+
+/**
+ * \brief \c expandCall() reads \c call \c label or \c tail \c label, which jump to a label that may be anywhere in the program.
+ *
+ * \param [in,out] ss_input is the line being read, just after the mnemonic.
+ * \param [in] rd is the register the return address is written to, \c ra for \c call and \c x0 for \c tail.
+ *
+ * \details This adds a \c jal that may be relaxed, which \c layoutProgram() keeps as a \c jal if the label is within its 1 MiB reach
+ * and otherwise grows into \c auipc and \c jalr, which reach anywhere within 2 GiB.
+ * This function will error out if the operand is not a label.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::expandCall(stringstream &ss_input, uint32_t rd) {
+	string temp;
+	parsed_instruction instruction;
+
+	if (!nextToken(ss_input, temp)) {
+		error("missing operand");
+	}
+	getImmediate(temp, instruction);
+	if (instruction.label.size() == 0) {
+		error("expected a label, not \"" + temp + "\"");
+	}
+
+	instruction.op = isaId("jal");
+	instruction.rd = rd;
+	instruction.compress = rvc_active;
+	instruction.relax = true;
+	addItem(instruction);
+}
+
+/**
+ * \brief \c parsePseudo() reads a pseudo-instruction, one that the assembler writes as a sequence of real instructions.
+ *
+ * \param [in] mnemonic is the mnemonic of the line.
+ * \param [in,out] ss_input is the line being read, just after the mnemonic.
+ * \returns \c false if the mnemonic is not a pseudo-instruction, and nothing was read.
+ *
+ * \details This function will error out if a pseudo-instruction has an operand too many.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::parsePseudo(const string &mnemonic, stringstream &ss_input) {
+	string temp;
+
+	if (mnemonic.compare("select") == 0) {
+		expandSelect(ss_input);
+	} else if (mnemonic.compare("li") == 0) {
+		expandLi(ss_input);
+	} else if (mnemonic.compare("call") == 0) {
+		expandCall(ss_input, 1);
+	} else if (mnemonic.compare("tail") == 0) {
+		expandCall(ss_input, 0);
+	} else {
+		return false;
+	}
+
+	if (nextToken(ss_input, temp)) {
+		error("unexpected operand \"" + temp + "\"");
+	}
+	return true;
+}
+
+/**
+ * \brief \c parseLine() reads the label and instruction on one line.
+ *
+ * \param [in] input is the line from the file.
+ * \returns \c true if the line held an instruction, which is added to \c program.
+ *
+ * \details This function will error out if there are any issues.
+ * Label operands are left in \c parsed_instruction::label until \c process() has seen every label.
+ * \note This is the function that needs to be edited to add more instruction types.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::parseLine(string input) {
+	stringstream ss_input(input);
+	string temp;
+
+	if (!nextToken(ss_input, temp)) {
+		return false;
+	}
+
+	if (temp.at(temp.size() - 1) == ':') {
+		makeLabel(temp.substr(0, (temp.size() - 1)));
+		if (!nextToken(ss_input, temp)) {
+			return false;
+		}
+	}
+
+	if (temp.at(0) == '.') {
+		parseDirective(temp, ss_input);
+		return false;
+	}
+
+	if (parsePseudo(temp, ss_input)) {
+		return true;
+	}
+
+	parsed_instruction instruction;
+	instruction.op = getOpcodeId(temp, instruction.flags);
+	instruction.compress = rvc_active;
+
+	const bool has_operands = nextToken(ss_input, temp);
+	if (!has_operands && (isa_table[instruction.op].format != 'Z') && (isa_table[instruction.op].format != 'P')) {
+		error("missing operand");
+	}
+
+	switch (isa_table[instruction.op].format) {
+		case 'I':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			instruction.rs1 = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			getImmediate(temp, instruction);
+		break;
+		case 'L':
+			if ((isa_table[instruction.op].mask & 0x00000f80) == 0) {
+				instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+			} else {
+				ss_input.clear();
+				ss_input.seekg(current_column - 2);
+			}
+
+			instruction.rs1 = getMemoryOperand(ss_input, instruction);
+		break;
+		case 'S':
+			if ((isa_table[instruction.op].mask & 0x01f00000) == 0) {
+				instruction.rs2 = getRegister(temp.substr(0, (temp.size() - 1)));
+			} else {
+				ss_input.clear();
+				ss_input.seekg(current_column - 2);
+			}
+
+			instruction.rs1 = getMemoryOperand(ss_input, instruction);
+		break;
+		case 'U':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			getImmediate(temp, instruction);
+		break;
+		case 'R':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			instruction.rs1 = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			instruction.rs2 = getRegister(temp);
+		break;
+		case 'N':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			instruction.rs1 = getRegister(temp);
+		break;
+		case 'l':
+			instruction.rd = getFloatRegister(temp.substr(0, (temp.size() - 1)));
+
+			instruction.rs1 = getMemoryOperand(ss_input, instruction);
+		break;
+		case 's':
+			instruction.rs2 = getFloatRegister(temp.substr(0, (temp.size() - 1)));
+
+			instruction.rs1 = getMemoryOperand(ss_input, instruction);
+		break;
+		case 'r':
+		case 'G':
+		case 'H':
+		case 'Q': {
+			const char format = isa_table[instruction.op].format;
+			if (format == 'G') {
+				instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+			} else {
+				instruction.rd = getFloatRegister(temp.substr(0, (temp.size() - 1)));
+			}
+
+			bool more = getListOperand(ss_input, temp);
+			if (format == 'H') {
+				instruction.rs1 = getRegister(temp);
+			} else {
+				instruction.rs1 = getFloatRegister(temp);
+			}
+
+			if ((isa_table[instruction.op].mask & 0x01f00000) == 0) {
+				if (!more) {
+					error("missing operand");
+				}
+				more = getListOperand(ss_input, temp);
+				instruction.rs2 = getFloatRegister(temp);
+			}
+
+			if (format == 'Q') {
+				if (!more) {
+					error("missing operand");
+				}
+				more = getListOperand(ss_input, temp);
+				instruction.flags |= getFloatRegister(temp) << 27;
+			}
+
+			getRoundingMode(ss_input, instruction, more);
+		} break;
+		case 'C':
+		case 'W': {
+			const uint32_t mask = isa_table[instruction.op].mask;
+			bool more = true;
+			ss_input.clear();
+			ss_input.seekg(current_column - 2);
+
+			if ((mask & 0x00000f80) == 0) {
+				more = getListOperand(ss_input, temp);
+				instruction.rd = getRegister(temp);
+			}
+
+			if ((mask & 0xfff00000) == 0) {
+				if (!more) {
+					error("missing operand");
+				}
+				more = getListOperand(ss_input, temp);
+				instruction.imm = getCsr(temp);
+			}
+
+			if ((mask & 0x000f8000) == 0) {
+				if (!more) {
+					error("missing operand");
+				}
+				more = getListOperand(ss_input, temp);
+				if (isa_table[instruction.op].format == 'C') {
+					instruction.rs1 = getRegister(temp);
+				} else {
+					parsed_instruction uimm;
+					getImmediate(temp, uimm);
+					if (uimm.label.size() != 0) {
+						error("invalid immediate \"" + temp + "\"");
+					}
+					instruction.rs1 = (uint32_t)checkImmediate<0, 31>(uimm.imm);
+				}
+			}
+
+			if (more) {
+				error("unexpected operand after \"" + temp + "\"");
+			}
+		} break;
+		case 'V':
+		case 'X':
+		case 'Y': {
+			instruction.rd = getVectorRegister(temp.substr(0, (temp.size() - 1)));
+
+			if ((isa_table[instruction.op].mask & 0x01f00000) == 0) {
+				getOperand(ss_input, temp);
+				instruction.rs2 = getVectorRegister(temp.substr(0, (temp.size() - 1)));
+			}
+
+			const bool more = getListOperand(ss_input, temp);
+			if (isa_table[instruction.op].format == 'V') {
+				instruction.rs1 = getVectorRegister(temp);
+			} else if (isa_table[instruction.op].format == 'X') {
+				instruction.rs1 = getRegister(temp);
+			} else {
+				getImmediate(temp, instruction);
+				if (instruction.label.size() != 0) {
+					error("invalid immediate \"" + temp + "\"");
+				}
+			}
+
+			getVectorMask(ss_input, instruction, more);
+		} break;
+		case 'E': {
+			instruction.rd = getVectorRegister(temp.substr(0, (temp.size() - 1)));
+
+			bool more = getListOperand(ss_input, temp);
+			instruction.rs1 = getAddressRegister(temp);
+
+			if ((isa_table[instruction.op].mask & 0x01f00000) == 0) {
+				if (!more) {
+					error("missing operand");
+				}
+				more = getListOperand(ss_input, temp);
+				if (((isa_table[instruction.op].match >> 26) & 3) == 2) {
+					instruction.rs2 = getRegister(temp);
+				} else {
+					instruction.rs2 = getVectorRegister(temp);
+				}
+			}
+
+			getVectorMask(ss_input, instruction, more);
+		} break;
+		case 'K':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			if ((isa_table[instruction.op].match >> 30) == 3) {
+				parsed_instruction avl;
+				getImmediate(temp.substr(0, (temp.size() - 1)), avl);
+				if (avl.label.size() != 0) {
+					error("invalid immediate \"" + temp + "\"");
+				}
+				instruction.rs1 = (uint32_t)checkImmediate<0, 31>(avl.imm);
+			} else {
+				instruction.rs1 = getRegister(temp.substr(0, (temp.size() - 1)));
+			}
+
+			instruction.imm = getVectorType(ss_input);
+		break;
+		case 'J':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			getImmediate(temp, instruction);
+		break;
+		case 'B':
+			instruction.rs1 = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			instruction.rs2 = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			getOperand(ss_input, temp);
+			getImmediate(temp, instruction);
+			instruction.relax = (instruction.label.size() != 0);
+		break;
+		case 'A':
+			instruction.rd = getRegister(temp.substr(0, (temp.size() - 1)));
+
+			if ((isa_table[instruction.op].mask & 0x01f00000) == 0) {
+				getOperand(ss_input, temp);
+				instruction.rs2 = getRegister(temp.substr(0, (temp.size() - 1)));
+			}
+
+			getOperand(ss_input, temp);
+			instruction.rs1 = getAddressRegister(temp);
+		break;
+		case 'P':
+			instruction.imm = 0xff;
+			if (has_operands) {
+				instruction.imm = getFenceSet(temp.substr(0, (temp.size() - 1))) << 4;
+
+				getOperand(ss_input, temp);
+				instruction.imm |= getFenceSet(temp);
+			}
+		break;
+		case 'Z':
+			if (has_operands) {
+				error("unexpected operand \"" + temp + "\"");
+			}
+		break;
+		default:
+			error(string("unknown type \'") + isa_table[instruction.op].format + "\'");
+	}
+
+	if (instruction.label.size() == 0) {
+		checkFormatImmediate(instruction);
+	}
+
+	if (nextToken(ss_input, temp)) {
+		error("unexpected operand \"" + temp + "\"");
+	}
+
+	addItem(instruction);
+	return true;
+}
+
+/**
+ * \brief \c compressInstruction() finds the 16 bit C extension form of an instruction, if it has one its operands fit.
+ *
+ * \param [in] instruction is the instruction, with any label already resolved into \c imm.
+ * \param [out] output receives the compressed machine code.
+ * \returns \c true if the instruction can be compressed.
+ *
+ * \note This is the function that needs to be edited to compress more instructions.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::compressInstruction(const parsed_instruction &instruction, uint16_t &output) {
+	const uint32_t rd = instruction.rd, rs1 = instruction.rs1, rs2 = instruction.rs2;
+	const int64_t imm = instruction.imm;
+	uint32_t result = 0;
+
+	switch (instruction.op) {
+		case isaId("addi"):
+			if ((rd == 0) && (rs1 == 0) && (imm == 0)) {
+				result = 0x0001;
+			} else if ((rd != 0) && (rs1 == 0) && fitsImmediate(imm, -32, 31)) {
+				result = 0x4001 | (rd << 7) | scatterBits(rvc_ci_imm, imm);
+			} else if ((rd != 0) && (rd == rs1) && (imm != 0) && fitsImmediate(imm, -32, 31)) {
+				result = 0x0001 | (rd << 7) | scatterBits(rvc_ci_imm, imm);
+			} else if ((rd == 2) && (rs1 == 2) && (imm != 0) && fitsImmediate(imm, -512, 496, 16)) {
+				result = 0x6101 | scatterBits(rvc_addi16sp_imm, imm);
+			} else if (rvcRegister(rd) && (rs1 == 2) && fitsImmediate(imm, 4, 1020, 4)) {
+				result = 0x0000 | ((rd - 8) << 2) | scatterBits(rvc_addi4spn_imm, imm);
+			} else if ((rd != 0) && (rs1 != 0) && (imm == 0)) {
+				result = 0x8002 | (rd << 7) | (rs1 << 2);
+			}
+		break;
+		case isaId("addiw"):
+			if ((rd != 0) && (rd == rs1) && fitsImmediate(imm, -32, 31)) {
+				result = 0x2001 | (rd << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("lui"):
+			if ((rd != 0) && (rd != 2) && (fitsImmediate(imm, 1, 31) || fitsImmediate(imm, 0xfffe0, 0xfffff) || fitsImmediate(imm, -32, -1))) {
+				result = 0x6001 | (rd << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("slli"):
+			if ((rd != 0) && (rd == rs1) && (imm != 0)) {
+				result = 0x0002 | (rd << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("srli"):
+			if (rvcRegister(rd) && (rd == rs1) && (imm != 0)) {
+				result = 0x8001 | ((rd - 8) << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("srai"):
+			if (rvcRegister(rd) && (rd == rs1) && (imm != 0)) {
+				result = 0x8401 | ((rd - 8) << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("andi"):
+			if (rvcRegister(rd) && (rd == rs1) && fitsImmediate(imm, -32, 31)) {
+				result = 0x8801 | ((rd - 8) << 7) | scatterBits(rvc_ci_imm, imm);
+			}
+		break;
+		case isaId("add"):
+			if ((rd != 0) && (rs1 == 0) && (rs2 != 0)) {
+				result = 0x8002 | (rd << 7) | (rs2 << 2);
+			} else if ((rd != 0) && (rd == rs1) && (rs2 != 0)) {
+				result = 0x9002 | (rd << 7) | (rs2 << 2);
+			} else if ((rd != 0) && (rd == rs2) && (rs1 != 0)) {
+				result = 0x9002 | (rd << 7) | (rs1 << 2);
+			} else if ((rd != 0) && (rs1 != 0) && (rs2 == 0)) {
+				result = 0x8002 | (rd << 7) | (rs1 << 2);
+			}
+		break;
+		case isaId("sub"):
+		case isaId("subw"):
+		case isaId("xor"):
+		case isaId("or"):
+		case isaId("and"):
+		case isaId("addw"): {
+			uint32_t other = rs2;
+			if ((rd != rs1) && (rd == rs2) && (instruction.op != isaId("sub")) && (instruction.op != isaId("subw"))) {
+				other = rs1;
+			} else if (rd != rs1) {
+				break;
+			}
+			if (rvcRegister(rd) && rvcRegister(other)) {
+				switch (instruction.op) {
+					case isaId("sub"):  result = 0x8c01; break;
+					case isaId("xor"):  result = 0x8c21; break;
+					case isaId("or"):   result = 0x8c41; break;
+					case isaId("and"):  result = 0x8c61; break;
+					case isaId("subw"): result = 0x9c01; break;
+					case isaId("addw"): result = 0x9c21; break;
+				}
+				result |= ((rd - 8) << 7) | ((other - 8) << 2);
+			}
+		} break;
+		case isaId("lw"):
+			if (rvcRegister(rd) && rvcRegister(rs1) && fitsImmediate(imm, 0, 124, 4)) {
+				result = 0x4000 | ((rs1 - 8) << 7) | ((rd - 8) << 2) | scatterBits(rvc_lw_imm, imm);
+			} else if ((rd != 0) && (rs1 == 2) && fitsImmediate(imm, 0, 252, 4)) {
+				result = 0x4002 | (rd << 7) | scatterBits(rvc_lwsp_imm, imm);
+			}
+		break;
+		case isaId("ld"):
+			if (rvcRegister(rd) && rvcRegister(rs1) && fitsImmediate(imm, 0, 248, 8)) {
+				result = 0x6000 | ((rs1 - 8) << 7) | ((rd - 8) << 2) | scatterBits(rvc_ld_imm, imm);
+			} else if ((rd != 0) && (rs1 == 2) && fitsImmediate(imm, 0, 504, 8)) {
+				result = 0x6002 | (rd << 7) | scatterBits(rvc_ldsp_imm, imm);
+			}
+		break;
+		case isaId("sw"):
+			if (rvcRegister(rs2) && rvcRegister(rs1) && fitsImmediate(imm, 0, 124, 4)) {
+				result = 0xc000 | ((rs1 - 8) << 7) | ((rs2 - 8) << 2) | scatterBits(rvc_lw_imm, imm);
+			} else if ((rs1 == 2) && fitsImmediate(imm, 0, 252, 4)) {
+				result = 0xc002 | (rs2 << 2) | scatterBits(rvc_swsp_imm, imm);
+			}
+		break;
+		case isaId("sd"):
+			if (rvcRegister(rs2) && rvcRegister(rs1) && fitsImmediate(imm, 0, 248, 8)) {
+				result = 0xe000 | ((rs1 - 8) << 7) | ((rs2 - 8) << 2) | scatterBits(rvc_ld_imm, imm);
+			} else if ((rs1 == 2) && fitsImmediate(imm, 0, 504, 8)) {
+				result = 0xe002 | (rs2 << 2) | scatterBits(rvc_sdsp_imm, imm);
+			}
+		break;
+		case isaId("flw"):
+			if (!xlen_traits<XLEN>::rv64 && rvcRegister(rd) && rvcRegister(rs1) && fitsImmediate(imm, 0, 124, 4)) {
+				result = 0x6000 | ((rs1 - 8) << 7) | ((rd - 8) << 2) | scatterBits(rvc_lw_imm, imm);
+			} else if (!xlen_traits<XLEN>::rv64 && (rs1 == 2) && fitsImmediate(imm, 0, 252, 4)) {
+				result = 0x6002 | (rd << 7) | scatterBits(rvc_lwsp_imm, imm);
+			}
+		break;
+		case isaId("fld"):
+			if (rvcRegister(rd) && rvcRegister(rs1) && fitsImmediate(imm, 0, 248, 8)) {
+				result = 0x2000 | ((rs1 - 8) << 7) | ((rd - 8) << 2) | scatterBits(rvc_ld_imm, imm);
+			} else if ((rs1 == 2) && fitsImmediate(imm, 0, 504, 8)) {
+				result = 0x2002 | (rd << 7) | scatterBits(rvc_ldsp_imm, imm);
+			}
+		break;
+		case isaId("fsw"):
+			if (!xlen_traits<XLEN>::rv64 && rvcRegister(rs2) && rvcRegister(rs1) && fitsImmediate(imm, 0, 124, 4)) {
+				result = 0xe000 | ((rs1 - 8) << 7) | ((rs2 - 8) << 2) | scatterBits(rvc_lw_imm, imm);
+			} else if (!xlen_traits<XLEN>::rv64 && (rs1 == 2) && fitsImmediate(imm, 0, 252, 4)) {
+				result = 0xe002 | (rs2 << 2) | scatterBits(rvc_swsp_imm, imm);
+			}
+		break;
+		case isaId("fsd"):
+			if (rvcRegister(rs2) && rvcRegister(rs1) && fitsImmediate(imm, 0, 248, 8)) {
+				result = 0xa000 | ((rs1 - 8) << 7) | ((rs2 - 8) << 2) | scatterBits(rvc_ld_imm, imm);
+			} else if ((rs1 == 2) && fitsImmediate(imm, 0, 504, 8)) {
+				result = 0xa002 | (rs2 << 2) | scatterBits(rvc_sdsp_imm, imm);
+			}
+		break;
+		case isaId("jal"):
+			if ((rd == 0) && fitsImmediate(imm, -2048, 2046, 2)) {
+				result = 0xa001 | scatterBits(rvc_j_imm, imm);
+			} else if ((rd == 1) && !xlen_traits<XLEN>::rv64 && fitsImmediate(imm, -2048, 2046, 2)) {
+				result = 0x2001 | scatterBits(rvc_j_imm, imm);
+			}
+		break;
+		case isaId("jalr"):
+			if ((rd == 0) && (rs1 != 0) && (imm == 0)) {
+				result = 0x8002 | (rs1 << 7);
+			} else if ((rd == 1) && (rs1 != 0) && (imm == 0)) {
+				result = 0x9002 | (rs1 << 7);
+			}
+		break;
+		case isaId("ntl.p1"):
+		case isaId("ntl.pall"):
+		case isaId("ntl.s1"):
+		case isaId("ntl.all"):
+			result = 0x9002 | (((isa_table[instruction.op].match >> rs2_lsb) & 0x1f) << 2);
+		break;
+		case isaId("beq"):
+			if (rvcRegister(rs1) && (rs2 == 0) && fitsImmediate(imm, -256, 254, 2)) {
+				result = 0xc001 | ((rs1 - 8) << 7) | scatterBits(rvc_b_imm, imm);
+			}
+		break;
+		case isaId("bne"):
+			if (rvcRegister(rs1) && (rs2 == 0) && fitsImmediate(imm, -256, 254, 2)) {
+				result = 0xe001 | ((rs1 - 8) << 7) | scatterBits(rvc_b_imm, imm);
+			}
+		break;
+	}
+
+	output = result;
+	return result != 0;
+}
+
+/**
+ * \brief \c resolveLabels() finds the instruction each label operand refers to.
+ *
+ * \details Undefined labels are recorded in \c diagnostics and the operand is pointed back at its own instruction.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::resolveLabels() {
+	for (parsed_instruction &instruction : program) {
+		if (instruction.label.size() == 0) {
+			continue;
+		}
+		current_line = instruction.line;
+		current_column = instruction.column;
+		try {
+			instruction.target = findLabelPos(instruction.label);
+		} catch (const assembly_error &e) {
+			diagnostics.push_back({current_line, current_column, e.what()});
+			instruction.target = instruction.pos;
+		}
+	}
+}
+
+/**
+ * \brief \c rebuildProgram() puts the items of the program in a new order, leaving out any that are not listed.
+ *
+ * \param [in] order is the index of each item to keep, in the order they are to be laid out.
+ *
+ * \details The positions of the items, the label operands that point at them and \c labels are all changed to match,
+ * so this may be used by any pass once \c resolveLabels() has run. Only items that are not \c ITEM_LABEL may be left out.
+ * New items may be added by pushing them onto the end of the program with their \c pos set, and listing them in \c order.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::rebuildProgram(const vector <uint64_t> &order) {
+	vector <uint64_t> moved(program.size(), order.size());
+	vector <parsed_instruction> rebuilt;
+
+	rebuilt.reserve(order.size());
+	for (uint64_t i = 0; i < order.size(); i++) {
+		moved[order[i]] = i;
+		rebuilt.push_back(program[order[i]]);
+		rebuilt.back().pos = i;
+	}
+	for (parsed_instruction &item : rebuilt) {
+		if (item.label.size() != 0) {
+			item.target = (item.target < moved.size()) ? moved[item.target] : rebuilt.size();
+		}
+	}
+	for (pair <const string, uint64_t> &label : labels) {
+		label.second = moved[label.second];
+	}
+	program.swap(rebuilt);
+}
+
+/**
+ * \brief \c reachBound() gives the most bytes an item may take, whatever \c layoutProgram() decides.
+ * \details This lets a pass that runs before the layout tell if a label is sure to be in reach.
+ */
+template <unsigned XLEN>
+uint64_t risc_v_assembler<XLEN>::reachBound(const parsed_instruction &item) {
+	switch (item.kind) {
+		case ITEM_INSTRUCTION:
+			return item.relax ? 8 : 4;
+		case ITEM_ALIGN:
+			return min((uint64_t)item.imm - 1, item.limit);
+		default:
+			return item.size;
+	}
+}
+
+/**
+ * \brief \c fixedSections() finds the sections whose code must stay exactly as it is, because it has an \c auipc or a branch or jump to a number
+ * rather than a label, whose target would not move with the code around it.
+ *
+ * \param [in] pass names the pass asking, for the report of each section it leaves alone.
+ * \param [out] fixed receives a flag for each section in \c sections.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::fixedSections(const string &pass, vector <bool> &fixed) {
+	fixed.assign(sections.size(), false);
+	for (const parsed_instruction &item : program) {
+		if (item.kind != ITEM_INSTRUCTION) {
+			continue;
+		}
+		const char format = isa_table[item.op].format;
+		fixed[item.section] = fixed[item.section] || (item.op == isaId("auipc")) || ((item.label.size() == 0) && ((format == 'B') || (format == 'J')));
+	}
+	for (uint32_t section = 0; section < sections.size(); section++) {
+		if (fixed[section]) {
+			cout << pass << " left " << sections[section].name << " as it is, it has an auipc or a branch to a number\n";
+		}
+	}
+}
+
+/**
+ * \brief \c peepholeProgram() makes small local improvements to the instructions read from the file, when \c OPTIMIZE_PEEPHOLE is set.
+ *
+ * \details Each instruction is looked at together with the one before it in the same section,
+ * so long as no label or directive comes between them, since a label between the two could be jumped to and must still see the first one's result.
+ * - A copy of a register into itself, such as \c addi \c rd, \c rd, \c 0, is removed.
+ * - \c addi \c rd, \c rs, \c a followed by \c addi \c rd, \c rd, \c b becomes \c addi \c rd, \c rs, \c a+b if the sum fits 12 bits.
+ * - A \c mul or \c mulw by a register the instruction before set to a power of two becomes \c slli or \c slliw,
+ *   and the constant is removed as well if the multiply overwrites it.
+ * - A jump, call or branch to a label whose first instruction is a \c jal \c x0 to another label goes straight to that label,
+ *   following at most \c thread_limit jumps so that a loop of jumps ends. A \c tail, whose \c jal may be relaxed, is not followed,
+ *   as it may reach further than the instruction could.
+ *   The new label must be in the same section and sure to be in reach by \c reachBound(): within the B-type reach for a branch,
+ *   within the J-type reach for a \c jal, or for a branch that may be relaxed, since that becomes a \c jal, and anywhere for a \c call.
+ *
+ * Instructions that write \c x0, and those whose immediate is a label other than the jumps and branches, are left alone,
+ * as are the sections \c fixedSections() finds, since removing or resizing an instruction there would move the target of a branch to a number.
+ * The number of instructions removed and changed is reported.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::peepholeProgram() {
+	static constexpr uint64_t none = UINT64_MAX;
+	static constexpr uint32_t thread_limit = 16;
+	vector <bool> removed(program.size(), false);
+	vector <uint64_t> previous(sections.size(), none);
+	vector <uint64_t> offset(program.size());
+	vector <uint64_t> counters(sections.size(), 0);
+	vector <bool> fixed;
+	uint64_t removals = 0;
+	uint64_t rewrites = 0;
+
+	fixedSections("peephole pass", fixed);
+	for (const parsed_instruction &item : program) {
+		offset[item.pos] = counters[item.section];
+		counters[item.section] += reachBound(item);
+	}
+
+	for (parsed_instruction &instruction : program) {
+		uint64_t &before = previous[instruction.section];
+		uint32_t source = 0;
+		int64_t value = 0;
+
+		if ((instruction.kind != ITEM_INSTRUCTION) || fixed[instruction.section]) {
+			before = none;
+			continue;
+		}
+		if (copiedRegister(instruction, source) && (source == instruction.rd) && (instruction.rd != 0)) {
+			removed[instruction.pos] = true;
+			removals++;
+			continue;
+		}
+		if (before == none) {
+			before = instruction.pos;
+			continue;
+		}
+
+		parsed_instruction &first = program[before];
+		if ((first.op == isaId("addi")) && (instruction.op == isaId("addi")) && (first.label.size() == 0) && (instruction.label.size() == 0)
+				&& (first.rd != 0) && (instruction.rd == first.rd) && (instruction.rs1 == first.rd)
+				&& fitsImmediate(first.imm + instruction.imm, signedMin(12), signedMax(12))) {
+			first.imm += instruction.imm;
+			removed[instruction.pos] = true;
+			removals++;
+			if (copiedRegister(first, source) && (source == first.rd)) {
+				removed[first.pos] = true;
+				removals++;
+				before = none;
+			} else {
+				rewrites++;
+			}
+			continue;
+		}
+
+		if (((instruction.op == isaId("mul")) || (instruction.op == isaId("mulw"))) && (instruction.rd != 0) && loadedConstant(first, value)
+				&& ((instruction.rs1 == first.rd) != (instruction.rs2 == first.rd))) {
+			const bool word = (instruction.op == isaId("mulw"));
+			const uint64_t bits = (uint64_t)value & ((word || !xlen_traits<XLEN>::rv64) ? fieldMask(32) : UINT64_MAX);
+			if ((bits != 0) && ((bits & (bits - 1)) == 0)) {
+				instruction.rs1 = (instruction.rs1 == first.rd) ? instruction.rs2 : instruction.rs1;
+				instruction.rs2 = 0;
+				instruction.op = word ? isaId("slliw") : isaId("slli");
+				instruction.imm = __builtin_ctzll(bits);
+				rewrites++;
+				if (instruction.rd == first.rd) {
+					removed[first.pos] = true;
+					removals++;
+				}
+			}
+		}
+		before = instruction.pos;
+	}
+
+	for (parsed_instruction &instruction : program) {
+		const char format = isa_table[instruction.op].format;
+		if ((instruction.kind != ITEM_INSTRUCTION) || removed[instruction.pos] || fixed[instruction.section] || (instruction.label.size() == 0)
+				|| ((format != 'B') && (format != 'J'))) {
+			continue;
+		}
+
+		const int64_t reach = ((format == 'B') && !instruction.relax) ? signedMax(format_layout<'B'>::imm_bits) : (signedMax(format_layout<'J'>::imm_bits) - 4);
+		const bool unbounded = (format == 'J') && instruction.relax;
+		uint64_t target = instruction.target;
+		for (uint32_t hop = 0; hop < thread_limit; hop++) {
+			if ((target >= program.size()) || (program[target].kind != ITEM_LABEL)) {
+				break;
+			}
+			uint64_t jump = target;
+			while ((jump < program.size()) && ((program[jump].section != program[target].section) || removed[jump] || (program[jump].kind == ITEM_LABEL))) {
+				jump++;
+			}
+			if ((jump == program.size()) || (program[jump].kind != ITEM_INSTRUCTION) || (program[jump].op != isaId("jal")) || (program[jump].rd != 0)
+					|| program[jump].relax || (program[jump].label.size() == 0) || (program[jump].target == target) || (program[jump].target >= program.size())) {
+				break;
+			}
+			const uint64_t next = program[jump].target;
+			const uint64_t distance = max(offset[next], offset[instruction.pos]) - min(offset[next], offset[instruction.pos]);
+			if ((program[next].section != instruction.section) || (!unbounded && (distance > (uint64_t)reach))) {
+				break;
+			}
+			target = next;
+			instruction.label = program[jump].label;
+		}
+		if (target != instruction.target) {
+			instruction.target = target;
+			rewrites++;
+		}
+	}
+
+	vector <uint64_t> order;
+	for (const parsed_instruction &item : program) {
+		if (!removed[item.pos]) {
+			order.push_back(item.pos);
+		}
+	}
+	rebuildProgram(order);
+
+	cout << "peephole pass removed " << removals << " and changed " << rewrites << " instructions\n";
+}
+
+/**
+ * \brief \c scheduleBlock() reorders the instructions of one basic block so that fewer of them wait for the result of the one before.
+ *
+ * \param [in] block is the position of each instruction in the block, in program order, all of which \c registerAccess() allows to move.
+ * \param [in,out] order is the new order of the program, whose entries at the positions in \c block are rewritten.
+ * \returns The number of instructions that were moved.
+ *
+ * \details An instruction depends on the last one to write each register it reads, after that one's latency from \c latencies,
+ * and must stay after the earlier reads and writes of the register it writes. Memory is treated as one location:
+ * loads may pass each other, but not a store, and stores keep their order.
+ * The scheduler then issues one instruction a cycle, the first in program order that is ready, or if none is ready the one that will be ready soonest.
+ * Only the \c schedule_window instructions from the first one not yet issued are looked at, so instructions only move a short way and a long block stays linear.
+ */
+template <unsigned XLEN>
+uint64_t risc_v_assembler<XLEN>::scheduleBlock(const vector <uint64_t> &block, vector <uint64_t> &order) {
+	static constexpr uint32_t schedule_window = 32;
+	static constexpr uint32_t none = UINT32_MAX;
+	const uint32_t size = (uint32_t)block.size();
+	vector <vector <pair <uint32_t, uint32_t>>> successors(size);
+	vector <uint32_t> waiting(size, 0);
+	vector <uint64_t> earliest(size, 0);
+	vector <bool> issued(size, false);
+	vector <uint32_t> readers[register_access::no_register];
+	uint32_t writer[register_access::no_register];
+	vector <uint32_t> loads;
+	uint32_t last_store = none;
+	uint64_t moved = 0;
+
+	if (size < 2) {
+		return 0;
+	}
+	fill(writer, writer + register_access::no_register, none);
+
+	for (uint32_t i = 0; i < size; i++) {
+		const parsed_instruction &instruction = program[block[i]];
+		register_access access;
+		registerAccess(instruction, access);
+
+		for (uint32_t r = 0; r < access.reads; r++) {
+			const uint32_t reg = access.read[r];
+			if (writer[reg] != none) {
+				successors[writer[reg]].push_back({i, latencies[latencyClass(program[block[writer[reg]]].op)]});
+				waiting[i]++;
+			}
+			readers[reg].push_back(i);
+		}
+		if (access.write != register_access::no_register) {
+			const uint32_t reg = access.write;
+			if (writer[reg] != none) {
+				successors[writer[reg]].push_back({i, 0});
+				waiting[i]++;
+			}
+			for (uint32_t reader : readers[reg]) {
+				if (reader != i) {
+					successors[reader].push_back({i, 0});
+					waiting[i]++;
+				}
+			}
+			readers[reg].clear();
+			writer[reg] = i;
+		}
+		if ((access.load || access.store) && (last_store != none)) {
+			successors[last_store].push_back({i, 0});
+			waiting[i]++;
+		}
+		if (access.load) {
+			loads.push_back(i);
+		}
+		if (access.store) {
+			for (uint32_t load : loads) {
+				successors[load].push_back({i, 0});
+				waiting[i]++;
+			}
+			loads.clear();
+			last_store = i;
+		}
+	}
+
+	uint64_t cycle = 0;
+	uint32_t first = 0;
+	for (uint32_t slot = 0; slot < size; slot++) {
+		while (issued[first]) {
+			first++;
+		}
+		uint32_t pick = none;
+		uint32_t soonest = none;
+		for (uint32_t i = first; (i < size) && (i < first + schedule_window); i++) {
+			if (issued[i] || (waiting[i] != 0)) {
+				continue;
+			}
+			if (earliest[i] <= cycle) {
+				pick = i;
+				break;
+			}
+			if ((soonest == none) || (earliest[i] < earliest[soonest])) {
+				soonest = i;
+			}
+		}
+		if (pick == none) {
+			pick = soonest;
+			cycle = earliest[pick];
+		}
+
+		issued[pick] = true;
+		for (const pair <uint32_t, uint32_t> &successor : successors[pick]) {
+			earliest[successor.first] = max(earliest[successor.first], cycle + successor.second);
+			waiting[successor.first]--;
+		}
+		cycle++;
+
+		order[block[slot]] = block[pick];
+		moved += (pick != slot);
+	}
+	return moved;
+}
+
+/**
+ * \brief \c scheduleProgram() runs \c scheduleBlock() over every basic block of the program, when \c OPTIMIZE_SCHEDULE is set.
+ *
+ * \details A basic block here is a run of instructions in one section that \c registerAccess() allows to move,
+ * so it ends at every label, directive, jump, branch and instruction that must stay where it is.
+ * The instruction after a non-temporal hint stays where it is as well, so the hint still applies to it.
+ * The sections \c fixedSections() finds are left alone, since a branch to a number may land in the middle of a run.
+ * The number of instructions moved is reported.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::scheduleProgram() {
+	vector <uint64_t> order(program.size());
+	vector <vector <uint64_t>> blocks(sections.size());
+	vector <bool> hinted(sections.size(), false);
+	vector <bool> fixed;
+	uint64_t moved = 0;
+
+	fixedSections("scheduler", fixed);
+
+	for (uint64_t i = 0; i < program.size(); i++) {
+		order[i] = i;
+	}
+	for (const parsed_instruction &item : program) {
+		vector <uint64_t> &block = blocks[item.section];
+		register_access access;
+		const bool movable = registerAccess(item, access) && !hinted[item.section] && !fixed[item.section];
+
+		hinted[item.section] = (item.kind == ITEM_INSTRUCTION) && (isa_table[item.op].extension == RV_ZIHINTNTL);
+		if (movable) {
+			block.push_back(item.pos);
+		} else {
+			moved += scheduleBlock(block, order);
+			block.clear();
+		}
+	}
+	for (const vector <uint64_t> &block : blocks) {
+		moved += scheduleBlock(block, order);
+	}
+	rebuildProgram(order);
+
+	cout << "scheduler moved " << moved << " instructions\n";
+}
+
+/**
+ * \brief \c fusesWith() tells if two instructions are one of \c fusion_pairs, with the registers a core needs to fuse them.
+ *
+ * \param [in] first is the instruction that would come first.
+ * \param [in] second is the instruction that would come straight after it.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::fusesWith(const parsed_instruction &first, const parsed_instruction &second) {
+	if ((first.kind != ITEM_INSTRUCTION) || (second.kind != ITEM_INSTRUCTION) || (first.rd == 0) || (second.rd != first.rd)) {
+		return false;
+	}
+	if ((second.rs1 != first.rd) && ((second.rs2 != first.rd) || (isa_table[second.op].format != 'R'))) {
+		return false;
+	}
+	for (const fusion_pair &fusion : fusion_pairs) {
+		if ((fusion.first == first.op) && (fusion.second == second.op)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * \brief \c fuseProgram() moves the two instructions of each pair in \c fusion_pairs next to each other, when \c OPTIMIZE_FUSION is set.
+ *
+ * \details For each instruction that starts a pair, the next \c fusion_window instructions in its section are searched for one that ends it.
+ * The search stops at any label, directive or instruction that must stay where it is, and at any instruction that reads or writes the
+ * first one's \c rd, since it would see a different value once the pair is together.
+ * The second instruction is then moved up to the first if \c commutes() lets it pass every instruction between them,
+ * and otherwise the first is moved down to the second. The sections \c fixedSections() finds are left as they are.
+ * Each instruction is in at most one pair, taken in program order. The number of instructions moved and pairs found is reported.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::fuseProgram() {
+	static constexpr uint32_t fusion_window = 16;
+	vector <uint64_t> order(program.size());
+	vector <vector <uint64_t>> sequences(sections.size());
+	vector <bool> paired(program.size(), false);
+	uint64_t moved = 0;
+	uint64_t pairs = 0;
+	vector <bool> fixed;
+
+	fixedSections("fusion pass", fixed);
+	for (const parsed_instruction &item : program) {
+		sequences[item.section].push_back(item.pos);
+	}
+
+	for (vector <uint64_t> &sequence : sequences) {
+		for (uint64_t k = 0; k < sequence.size(); k++) {
+			const parsed_instruction &first = program[sequence[k]];
+			if ((first.kind != ITEM_INSTRUCTION) || paired[first.pos] || (first.label.size() != 0) || fixed[first.section]) {
+				continue;
+			}
+
+			uint64_t found = 0;
+			for (uint64_t j = k + 1; (j < sequence.size()) && (j <= k + fusion_window); j++) {
+				const parsed_instruction &between = program[sequence[j]];
+				register_access access;
+				if (!paired[between.pos] && fusesWith(first, between)) {
+					found = j;
+					break;
+				}
+				if (!registerAccess(between, access) || (access.write == first.rd)
+						|| (count(access.read, access.read + access.reads, first.rd) != 0)) {
+					break;
+				}
+			}
+			if (found == 0) {
+				continue;
+			}
+
+			register_access access;
+			bool up = true;
+			bool down = registerAccess(first, access) && ((k == 0) || (program[sequence[k - 1]].kind != ITEM_INSTRUCTION)
+					|| (isa_table[program[sequence[k - 1]].op].extension != RV_ZIHINTNTL));
+			for (uint64_t j = k + 1; j < found; j++) {
+				up = up && commutes(program[sequence[j]], program[sequence[found]]);
+				down = down && commutes(first, program[sequence[j]]);
+			}
+			if (up) {
+				rotate(sequence.begin() + k + 1, sequence.begin() + found, sequence.begin() + found + 1);
+				moved += (found != k + 1);
+				paired[sequence[k]] = paired[sequence[k + 1]] = true;
+				pairs++;
+			} else if (down) {
+				rotate(sequence.begin() + k, sequence.begin() + k + 1, sequence.begin() + found);
+				moved++;
+				paired[sequence[found - 1]] = paired[sequence[found]] = true;
+				pairs++;
+				k--;
+			}
+		}
+	}
+
+	vector <uint64_t> slots;
+	for (const vector <uint64_t> &sequence : sequences) {
+		slots.assign(sequence.begin(), sequence.end());
+		sort(slots.begin(), slots.end());
+		for (uint64_t i = 0; i < slots.size(); i++) {
+			order[slots[i]] = sequence[i];
+		}
+	}
+	rebuildProgram(order);
+
+	cout << "fusion pass moved " << moved << " instructions to make " << pairs << " fused pairs\n";
+}
+
+/**
+ * \brief \c outlineProgram() replaces sequences of instructions that appear more than once with calls to one shared copy, when \c OPTIMIZE_OUTLINE is set.
+ *
+ * \details The instructions of each code section whose blocks \c findBlocks() lets move are written as a string, equal instructions being the same
+ * symbol and anything that may not be outlined a symbol of its own, so no repeat runs over it. Only instructions \c registerAccess() lets move may be
+ * outlined, as only they do the same wherever they are, and not the one after a hint, which must stay in front of it.
+ * Every repeat is an interval of \c suffixArray() whose suffixes share a prefix of some length, found bottom up with a stack as in a suffix tree.
+ * A repeat saves its size in bytes at each copy that does not overlap another, less a 4 byte \c jal at each, and costs a copy of itself and a return,
+ * compressed if the copy is. The repeats that save anything are taken most saving first, dropping the copies that overlap ones already outlined.
+ * A repeat longer than \c outline_limit instructions is cut to that length, and the longer repeats inside it are not looked at,
+ * so long runs of the same instructions are outlined in pieces and the search stays linear in the size of the program.
+ *
+ * Each shared copy ends with \c jalr \c x0 back through the link register, which is the first of \c t0 to \c t6 that no instruction in the program names,
+ * so that \c ra, and so the return address of the function the copy came from, is kept. If they are all named nothing is outlined.
+ * The calls may be relaxed, and the copies are put in \c .text.outlined, which is added after the sections already used.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::outlineProgram() {
+	static constexpr uint32_t link_registers[] = {5, 6, 7, 28, 29, 30, 31};
+	static constexpr uint32_t separator = 0x80000000;
+	static constexpr int64_t call_bytes = 4;
+	static constexpr uint32_t outline_limit = 64;
+	const uint32_t selected = current_section;
+	vector <bool> named(32, false);
+	vector <vector <uint64_t>> sequences(sections.size());
+	vector <code_block> blocks;
+	register_access access;
+	uint16_t compressed = 0;
+
+	for (const parsed_instruction &item : program) {
+		sequences[item.section].push_back(item.pos);
+		if (item.kind != ITEM_INSTRUCTION) {
+			continue;
+		}
+		if (registerAccess(item, access)) {
+			named[access.write % 32] = named[access.write % 32] || (access.write < 32);
+			for (uint32_t i = 0; i < access.reads; i++) {
+				named[access.read[i] % 32] = named[access.read[i] % 32] || (access.read[i] < 32);
+			}
+		} else {
+			named[item.rd % 32] = named[item.rs1 % 32] = named[item.rs2 % 32] = true;
+		}
+	}
+	uint32_t link = 0;
+	for (uint32_t reg : link_registers) {
+		if (!named[reg]) {
+			link = reg;
+			break;
+		}
+	}
+	if (link == 0) {
+		cout << "outlined nothing, t0 to t6 are all used so there is no register to return through\n";
+		return;
+	}
+
+	vector <uint32_t> text;
+	vector <uint64_t> item_at;
+	vector <int64_t> bytes_before = {0};
+	map <tuple <uint32_t, uint32_t, uint32_t, uint32_t, int64_t, uint32_t, bool>, uint32_t> symbols;
+	for (uint32_t section = 0; section < sections.size(); section++) {
+		if (!sections[section].code || sequences[section].empty() || !findBlocks(section, blocks)) {
+			continue;
+		}
+		bool hinted = false;
+		for (uint64_t pos : sequences[section]) {
+			const parsed_instruction &item = program[pos];
+			uint32_t symbol = separator + (uint32_t)text.size();
+			int64_t size = 0;
+			if (registerAccess(item, access) && !hinted) {
+				const auto key = make_tuple(item.op, item.rd, item.rs1, item.rs2, item.imm, item.flags, item.compress);
+				symbol = symbols.insert({key, (uint32_t)symbols.size()}).first->second;
+				size = (item.compress && compressInstruction(item, compressed)) ? 2 : 4;
+			}
+			hinted = (item.kind == ITEM_INSTRUCTION) && (isa_table[item.op].extension == RV_ZIHINTNTL);
+			text.push_back(symbol);
+			item_at.push_back(pos);
+			bytes_before.push_back(bytes_before.back() + size);
+		}
+		text.push_back(separator + (uint32_t)text.size());
+		item_at.push_back(program.size());
+		bytes_before.push_back(bytes_before.back());
+	}
+
+	vector <uint32_t> suffixes, common;
+	vector <outline_candidate> candidates;
+	vector <pair <uint32_t, uint32_t>> open;
+	const auto benefit = [&](uint32_t length, const vector <uint32_t> &starts) {
+		const int64_t bytes = bytes_before[starts[0] + length] - bytes_before[starts[0]];
+		const int64_t return_bytes = program[item_at[starts[0]]].compress ? 2 : 4;
+		return (int64_t)starts.size() * (bytes - call_bytes) - bytes - return_bytes;
+	};
+	suffixArray(text, suffixes, common);
+	for (uint32_t i = 1; i <= text.size(); i++) {
+		const uint32_t length = (i < text.size()) ? common[i] : 0;
+		uint32_t first = i - 1;
+		while (!open.empty() && (length < open.back().first)) {
+			const pair <uint32_t, uint32_t> interval = open.back();
+			first = interval.second;
+			open.pop_back();
+			if ((interval.first > outline_limit) && (max(length, open.empty() ? 0 : open.back().first) >= outline_limit)) {
+				continue;
+			}
+			outline_candidate candidate = {min(interval.first, outline_limit), vector <uint32_t>(suffixes.begin() + interval.second, suffixes.begin() + i), 0};
+
+			sort(candidate.starts.begin(), candidate.starts.end());
+			uint32_t kept = 0;
+			for (uint32_t start : candidate.starts) {
+				if ((kept == 0) || (start >= candidate.starts[kept - 1] + candidate.length)) {
+					candidate.starts[kept++] = start;
+				}
+			}
+			candidate.starts.resize(kept);
+			if (kept >= 2) {
+				candidate.benefit = benefit(candidate.length, candidate.starts);
+				if (candidate.benefit > 0) {
+					candidates.push_back(candidate);
+				}
+			}
+		}
+		if ((length > 0) && (open.empty() || (length > open.back().first))) {
+			open.push_back({length, first});
+		}
+	}
+	sort(candidates.begin(), candidates.end(), [](const outline_candidate &a, const outline_candidate &b) {
+		if (a.benefit != b.benefit) {
+			return a.benefit > b.benefit;
+		}
+		return (a.length != b.length) ? (a.length > b.length) : (a.starts[0] < b.starts[0]);
+	});
+
+	const uint64_t none = UINT64_MAX;
+	const uint64_t original = program.size();
+	vector <bool> outlined(text.size(), false);
+	vector <uint64_t> call_at(original, none);
+	vector <bool> dropped(original, false);
+	vector <uint64_t> copies;
+	uint32_t outlined_section = 0;
+	uint64_t functions = 0, calls = 0;
+	int64_t saved = 0;
+
+	for (outline_candidate &candidate : candidates) {
+		vector <uint32_t> starts;
+		for (uint32_t start : candidate.starts) {
+			if (find(outlined.begin() + start, outlined.begin() + start + candidate.length, true) == outlined.begin() + start + candidate.length) {
+				starts.push_back(start);
+			}
+		}
+		if ((starts.size() < 2) || (benefit(candidate.length, starts) <= 0)) {
+			continue;
+		}
+		if (functions == 0) {
+			selectSection(".text.outlined");
+			outlined_section = current_section;
+			current_section = selected;
+		}
+
+		parsed_instruction label;
+		label.kind = ITEM_LABEL;
+		label.size = 0;
+		label.section = outlined_section;
+		label.pos = program.size();
+		program.push_back(label);
+		copies.push_back(label.pos);
+		for (uint32_t k = 0; k < candidate.length; k++) {
+			parsed_instruction copy = program[item_at[starts[0] + k]];
+			copy.section = outlined_section;
+			copy.pos = program.size();
+			program.push_back(copy);
+			copies.push_back(copy.pos);
+		}
+		parsed_instruction back;
+		back.op = isaId("jalr");
+		back.rs1 = link;
+		back.section = outlined_section;
+		back.line = program[item_at[starts[0]]].line;
+		back.compress = program[item_at[starts[0]]].compress;
+		back.pos = program.size();
+		program.push_back(back);
+		copies.push_back(back.pos);
+
+		for (uint32_t start : starts) {
+			parsed_instruction call;
+			call.op = isaId("jal");
+			call.rd = link;
+			call.label = ".L" + to_string(label.pos);
+			call.target = label.pos;
+			call.relax = true;
+			call.section = program[item_at[start]].section;
+			call.line = program[item_at[start]].line;
+			call.compress = program[item_at[start]].compress;
+			call.pos = program.size();
+			program.push_back(call);
+			call_at[item_at[start]] = call.pos;
+			for (uint32_t k = 0; k < candidate.length; k++) {
+				outlined[start + k] = true;
+				dropped[item_at[start + k]] = true;
+			}
+		}
+		functions++;
+		calls += starts.size();
+		saved += benefit(candidate.length, starts);
+	}
+
+	vector <uint64_t> order;
+	for (uint64_t pos = 0; pos < original; pos++) {
+		if (call_at[pos] != none) {
+			order.push_back(call_at[pos]);
+		}
+		if (!dropped[pos]) {
+			order.push_back(pos);
+		}
+	}
+	order.insert(order.end(), copies.begin(), copies.end());
+	rebuildProgram(order);
+
+	cout << "outlined " << functions << " sequences, replacing " << calls << " copies with calls through x" << link << " and saving about " << saved << " bytes\n";
+}
+
+/**
+ * \brief \c alignBranchTargets() pads before loop heads, or every branch target, so that they start a fetch block,
+ * when \c OPTIMIZE_ALIGN_LOOPS or \c OPTIMIZE_ALIGN_TARGETS is set.
+ *
+ * \details A loop head is a label in a code section that a branch or \c jal \c x0 after it in the same section jumps back to.
+ * An \c ITEM_ALIGN of \c fetch_block bytes limited to \c padding_limit is put before it, or before the first of the labels if there are
+ * several in a row, so that \c layoutProgram() works out the padding from the final byte addresses, and \c writeItem() writes it as
+ * \c nop and \c c.nop. No padding goes into the sections \c fixedSections() finds, as it would move the target of a branch to a number.
+ * The number of labels aligned is reported.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::alignBranchTargets() {
+	vector <bool> wanted(program.size(), false);
+	vector <vector <uint64_t>> sequences(sections.size());
+	vector <bool> fixed;
+	vector <uint64_t> order;
+	uint64_t aligned = 0;
+
+	fixedSections("branch target alignment", fixed);
+
+	for (const parsed_instruction &instruction : program) {
+		const char format = isa_table[instruction.op].format;
+		if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.label.size() == 0) || ((format != 'B') && ((format != 'J') || (instruction.rd != 0)))) {
+			continue;
+		}
+		if ((instruction.target >= program.size()) || (program[instruction.target].kind != ITEM_LABEL)
+				|| (program[instruction.target].section != instruction.section) || !sections[instruction.section].code
+				|| fixed[instruction.section]) {
+			continue;
+		}
+		if ((optimizations & OPTIMIZE_ALIGN_TARGETS) || (instruction.target < instruction.pos)) {
+			wanted[instruction.target] = true;
+		}
+	}
+
+	for (const parsed_instruction &item : program) {
+		sequences[item.section].push_back(item.pos);
+	}
+	for (uint32_t section = 0; section < sections.size(); section++) {
+		const vector <uint64_t> &sequence = sequences[section];
+		for (uint64_t k = 0; k < sequence.size(); k++) {
+			if ((program[sequence[k]].kind == ITEM_LABEL) && ((k == 0) || (program[sequence[k - 1]].kind != ITEM_LABEL))) {
+				bool pad = false;
+				for (uint64_t next = k; (next < sequence.size()) && (program[sequence[next]].kind == ITEM_LABEL); next++) {
+					pad = pad || wanted[sequence[next]];
+				}
+				if (pad) {
+					parsed_instruction padding;
+					padding.kind = ITEM_ALIGN;
+					padding.size = 0;
+					padding.imm = (int64_t)fetch_block;
+					padding.limit = padding_limit;
+					padding.section = section;
+					padding.line = program[sequence[k]].line;
+					padding.pos = program.size();
+					order.push_back(padding.pos);
+					program.push_back(padding);
+					sections[section].alignment = max(sections[section].alignment, fetch_block);
+					aligned++;
+				}
+			}
+			order.push_back(sequence[k]);
+		}
+	}
+	rebuildProgram(order);
+
+	cout << "aligned " << aligned << " branch targets to " << fetch_block << " byte fetch blocks\n";
+}
+
+/**
+ * \brief \c findBlocks() splits a code section into basic blocks and finds where each one may go next.
+ *
+ * \param [in] section is the index of the section in \c sections.
+ * \param [out] blocks receives the blocks, in their original order.
+ * \returns \c false if the blocks may not be moved, because the section has an \c auipc or a branch or jump to a number rather than a label,
+ * whose target would move with it.
+ *
+ * \details A block ends with a branch, a \c jal \c x0 or a \c jalr \c x0. The first block and the blocks that a \c jal which saves its
+ * return address, or a \c call or \c tail, jumps to start functions.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::findBlocks(uint32_t section, vector <code_block> &blocks) {
+	vector <uint32_t> block_of(program.size(), code_block::no_block);
+	vector <bool> called(program.size(), false);
+	bool body = true;
+	bool ended = false;
+	bool movable = true;
+
+	blocks.clear();
+	for (const parsed_instruction &item : program) {
+		if ((item.kind == ITEM_INSTRUCTION) && (item.label.size() != 0) && (item.op == isaId("jal")) && ((item.rd != 0) || item.relax)
+				&& (item.target < program.size())) {
+			called[item.target] = true;
+		}
+		if (item.section != section) {
+			continue;
+		}
+
+		if (blocks.empty() || ended || (body && ((item.kind == ITEM_ALIGN) || (item.kind == ITEM_LABEL)))) {
+			blocks.push_back(code_block());
+			body = ended = false;
+		}
+		code_block &block = blocks.back();
+		block.items.push_back(item.pos);
+		block_of[item.pos] = (uint32_t)(blocks.size() - 1);
+		if (item.kind == ITEM_LABEL) {
+			block.label = (block.label == code_block::no_label) ? item.pos : block.label;
+		} else if (item.kind != ITEM_ALIGN) {
+			body = true;
+		}
+
+		if (item.kind == ITEM_INSTRUCTION) {
+			const char format = isa_table[item.op].format;
+			movable = movable && (item.op != isaId("auipc")) && ((item.label.size() != 0) || ((format != 'B') && (format != 'J')));
+			ended = (format == 'B') || ((item.rd == 0) && ((item.op == isaId("jal")) || (item.op == isaId("jalr"))));
+		}
+	}
+
+	for (uint32_t b = 0; b < blocks.size(); b++) {
+		code_block &block = blocks[b];
+		const parsed_instruction &last = program[block.items.back()];
+		const bool jump = (last.kind == ITEM_INSTRUCTION) && (last.rd == 0) && ((last.op == isaId("jal")) || (last.op == isaId("jalr")));
+
+		block.conditional = (last.kind == ITEM_INSTRUCTION) && (isa_table[last.op].format == 'B');
+		block.next = jump ? code_block::no_block : (b + 1);
+		if ((last.kind == ITEM_INSTRUCTION) && (block.conditional || (last.op == isaId("jal"))) && (last.target < program.size())) {
+			block.taken = block_of[last.target];
+		}
+		for (uint64_t pos : block.items) {
+			block.entry = block.entry || (b == 0) || called[pos];
+		}
+		block.function = block.entry ? b : blocks[b - 1].function;
+	}
+	return movable;
+}
+
+/**
+ * \brief \c placeBlocks() lists the items of a section's blocks in a new order and fixes up the branches and jumps so the program does the same.
+ *
+ * \param [in,out] blocks is the blocks from \c findBlocks(), which may be given labels.
+ * \param [in] placement is the index of each block in its new order, starting with block 0.
+ * \param [in] hot is the number of blocks at the start of \c placement that stay in the section, the rest are moved to the end of \c cold_section.
+ * \param [in] cold_section is the index in \c sections of the section the cold blocks are moved to.
+ * \param [in,out] order receives the position of every item of the section, in the new order.
+ *
+ * \details A block that no longer has the block it fell through to after it gets a \c jal \c x0 to it, unless it ends in a conditional
+ * branch whose other target now follows it, in which case the branch is inverted instead. A \c jal \c x0 to the block that now follows is removed.
+ * Blocks that need a label for this and have none are given one, and falling off the end of the section jumps to a label put there.
+ * The last hot block is followed by the end of the section and the last cold block by nothing, since what comes after it in \c cold_section is
+ * not part of the section. The added jumps are not relaxed, since relaxing them would need a scratch register.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::placeBlocks(vector <code_block> &blocks, const vector <uint32_t> &placement, uint32_t hot, uint32_t cold_section,
+		vector <uint64_t> &order) {
+	const uint32_t end = (uint32_t)blocks.size();
+	const uint32_t away = end + 1;
+	vector <uint32_t> following(blocks.size());
+	vector <bool> needs_label(blocks.size() + 1, false);
+	uint64_t end_label = code_block::no_label;
+	uint64_t moved = 0, added = 0, removed = 0, inverted = 0;
+
+	for (uint32_t k = 0; k < placement.size(); k++) {
+		following[placement[k]] = (k + 1 == hot) ? end : (k + 1 < placement.size()) ? placement[k + 1] : away;
+		moved += (k != 0) && (placement[k] != placement[k - 1] + 1);
+	}
+	for (uint32_t b = 0; b < blocks.size(); b++) {
+		if ((blocks[b].next != code_block::no_block) && (blocks[b].next != following[b])) {
+			needs_label[blocks[b].next] = true;
+		}
+	}
+
+	for (uint32_t b = 0; b <= blocks.size(); b++) {
+		if (!needs_label[b] || ((b < end) && (blocks[b].label != code_block::no_label))) {
+			continue;
+		}
+		parsed_instruction label;
+		label.kind = ITEM_LABEL;
+		label.size = 0;
+		label.section = program[blocks[0].items[0]].section;
+		label.pos = program.size();
+		program.push_back(label);
+		if (b == end) {
+			end_label = label.pos;
+			continue;
+		}
+		vector <uint64_t> &items = blocks[b].items;
+		uint64_t i = 0;
+		while ((i < items.size()) && (program[items[i]].kind == ITEM_ALIGN)) {
+			i++;
+		}
+		items.insert(items.begin() + i, label.pos);
+		blocks[b].label = label.pos;
+	}
+
+	for (uint32_t k = 0; k < placement.size(); k++) {
+		const uint32_t b = placement[k];
+		code_block &block = blocks[b];
+		parsed_instruction &last = program[block.items.back()];
+		const uint64_t target = (block.next == end) ? end_label : (block.next != code_block::no_block) ? blocks[block.next].label : code_block::no_label;
+
+		for (uint64_t pos : block.items) {
+			if (k >= hot) {
+				program[pos].section = cold_section;
+				if (program[pos].kind == ITEM_ALIGN) {
+					sections[cold_section].alignment = max(sections[cold_section].alignment, (uint64_t)program[pos].imm);
+				}
+			}
+			order.push_back(pos);
+		}
+		if ((block.next == code_block::no_block) && (last.op == isaId("jal")) && (block.taken != code_block::no_block) && (block.taken == following[b])) {
+			order.pop_back();
+			removed++;
+		} else if ((block.next != code_block::no_block) && (block.next != following[b])) {
+			if (block.conditional && (block.taken == following[b])) {
+				last.op = (uint32_t)instruction_decoder.decode(isa_table[last.op].match ^ 0x00001000);
+				last.target = target;
+				last.label = ".L" + to_string(target);
+				inverted++;
+			} else {
+				parsed_instruction jump;
+				jump.op = isaId("jal");
+				jump.label = ".L" + to_string(target);
+				jump.target = target;
+				jump.section = last.section;
+				jump.line = last.line;
+				jump.compress = (last.kind == ITEM_INSTRUCTION) && last.compress;
+				jump.pos = program.size();
+				order.push_back(jump.pos);
+				program.push_back(jump);
+				added++;
+			}
+		}
+	}
+	if (end_label != code_block::no_label) {
+		order.push_back(end_label);
+	}
+
+	cout << "moved " << moved << " of " << blocks.size() << " blocks away from the block before them, adding " << added << " jumps, removing " << removed
+			<< " and inverting " << inverted << " branches\n";
+}
+
+/**
+ * \brief \c profileCounts() gives each block of a section its count from the execution count profile.
+ *
+ * \param [in,out] blocks is the blocks from \c findBlocks(), whose \c count is set.
+ *
+ * \details Each block's count is the largest count in \c profile_labels of a label it starts with, or in \c profile_addresses of the address
+ * of one of its instructions, the addresses being those of the program laid out as it is before the block layout.
+ * A block with neither and no label can only be reached by falling into it, so it takes the count of the block before it.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::profileCounts(vector <code_block> &blocks) {
+	const uint32_t size = (uint32_t)blocks.size();
+	vector <uint32_t> block_of(program.size(), code_block::no_block);
+	vector <bool> profiled(size, false);
+
+	for (uint32_t b = 0; b < size; b++) {
+		for (uint64_t pos : blocks[b].items) {
+			block_of[pos] = b;
+			if ((program[pos].kind == ITEM_INSTRUCTION) && (profile_addresses.count(program[pos].address) != 0)) {
+				blocks[b].count = max(blocks[b].count, profile_addresses[program[pos].address]);
+				profiled[b] = true;
+			}
+		}
+	}
+	for (const pair <const string, uint64_t> &entry : profile_labels) {
+		const map <string, uint64_t>::const_iterator label = labels.find(entry.first);
+		if ((label != labels.end()) && (block_of[label->second] != code_block::no_block)) {
+			code_block &block = blocks[block_of[label->second]];
+			block.count = max(block.count, entry.second);
+			profiled[block_of[label->second]] = true;
+		}
+	}
+	for (uint32_t b = 1; b < size; b++) {
+		if (!profiled[b] && (blocks[b].label == code_block::no_label) && (blocks[b - 1].next == b)) {
+			blocks[b].count = blocks[b - 1].count;
+		}
+	}
+}
+
+/**
+ * \brief \c estimateCounts() guesses how often each block of a section runs, for the static block layout.
+ *
+ * \param [in,out] blocks is the blocks from \c findBlocks(), whose \c count is set.
+ *
+ * \details A branch or jump back to an earlier block of the same function closes a loop over the blocks between them,
+ * and each loop a block is in makes it \c loop_weight times hotter, up to \c loop_limit loops.
+ * Where a conditional branch goes to a block at the same depth, a successor that leaves the function, by returning or jumping to another
+ * function, or that only jumps out of the branch's loop, is taken to be an error or early exit path and is made 4 times colder than the other.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::estimateCounts(vector <code_block> &blocks) {
+	static constexpr uint64_t loop_weight = 8;
+	static constexpr uint32_t loop_limit = 6;
+	const uint32_t size = (uint32_t)blocks.size();
+	vector <uint32_t> latch(size, 0);
+	vector <uint32_t> depth(size, 0);
+	vector <bool> cold(size, false);
+
+	for (uint32_t b = 0; b < size; b++) {
+		const uint32_t header = blocks[b].taken;
+		if ((header <= b) && (blocks[header].function == blocks[b].function)) {
+			latch[header] = max(latch[header], b + 1);
+		}
+	}
+	for (uint32_t header = 0; header < size; header++) {
+		for (uint32_t b = header; b < latch[header]; b++) {
+			depth[b]++;
+		}
+	}
+
+	for (uint32_t b = 0; b < size; b++) {
+		if (!blocks[b].conditional) {
+			continue;
+		}
+		const uint32_t successors[2] = {blocks[b].next, blocks[b].taken};
+		bool exits[2] = {false, false};
+		for (uint32_t i = 0; i < 2; i++) {
+			const uint32_t s = successors[i];
+			if ((s >= size) || (s <= b) || (depth[s] != depth[b])) {
+				continue;
+			}
+			const uint32_t target = blocks[s].taken;
+			const bool leaves = (target == code_block::no_block) || (blocks[target].function != blocks[s].function) || (depth[target] < depth[b]);
+			exits[i] = (blocks[s].next == code_block::no_block) && leaves;
+		}
+		if (exits[0] != exits[1]) {
+			cold[successors[exits[0] ? 0 : 1]] = true;
+		}
+	}
+
+	for (uint32_t b = 0; b < size; b++) {
+		uint64_t count = cold[b] ? 1 : 4;
+		for (uint32_t d = 0; d < min(depth[b], loop_limit); d++) {
+			count *= loop_weight;
+		}
+		blocks[b].count = count;
+	}
+}
+
+/**
+ * \brief \c markCold() picks the blocks of a section that the hot/cold split moves to \c .text.cold.
+ *
+ * \param [in,out] blocks is the blocks from \c findBlocks(), whose \c cold is set.
+ * \returns The number of cold blocks.
+ *
+ * \details A block is cold if it starts with a label marked by \c .cold, or if the profile is being used, gives some block of the section a count
+ * and gives this one none. Marking the label of a function's first block makes the whole function cold,
+ * and a block with no label that is only reached by falling out of a cold block is cold too.
+ * The first block of the section is where it is entered, so it is never cold.
+ */
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::markCold(vector <code_block> &blocks) {
+	bool profiled = false;
+	uint32_t cold = 0;
+
+	if (optimizations & OPTIMIZE_PROFILE_LAYOUT) {
+		for (const code_block &block : blocks) {
+			profiled = profiled || (block.count != 0);
+		}
+	}
+	for (uint32_t b = 1; b < blocks.size(); b++) {
+		code_block &block = blocks[b];
+		for (uint64_t pos : block.items) {
+			block.cold = block.cold || program[pos].cold;
+		}
+		block.cold = block.cold || (profiled && (block.count == 0)) || blocks[block.function].cold;
+		block.cold = block.cold || ((block.label == code_block::no_label) && (blocks[b - 1].next == b) && blocks[b - 1].cold);
+		cold += block.cold;
+	}
+	return cold;
+}
+
+/**
+ * \brief \c chainBlocks() picks the order of a section's blocks from their counts.
+ *
+ * \param [in] blocks is the blocks, with their counts.
+ * \param [out] placement receives the index of each block in its new order.
+ *
+ * \details Within each function the blocks are joined into chains, taking the edges between them from heaviest to lightest, where an edge's weight
+ * is the smaller of the counts at its ends, and the original fall throughs before the branches when they tie. An edge joins two chains if it goes from the
+ * end of one to the start of the other and not to the start of a function, so a branch back to the start of its own chain stays a backward branch.
+ * The function's first chain comes first, then the rest hottest first,
+ * and the functions are put in the same way after the first, which stays at the start of the section.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::chainBlocks(const vector <code_block> &blocks, vector <uint32_t> &placement) {
+	const uint32_t size = (uint32_t)blocks.size();
+	vector <uint32_t> link(size, code_block::no_block), head(size), tail(size);
+	vector <pair <uint64_t, uint64_t>> edges;
+
+	for (uint32_t b = 0; b < size; b++) {
+		head[b] = tail[b] = b;
+		const uint32_t successors[2] = {blocks[b].next, blocks[b].taken};
+		for (uint32_t i = 0; i < 2; i++) {
+			const uint32_t to = successors[i];
+			if ((to < size) && (to != b) && !blocks[to].entry && (blocks[to].function == blocks[b].function)) {
+				edges.push_back({min(blocks[b].count, blocks[to].count), ((uint64_t)i << 32) | b});
+			}
+		}
+	}
+	sort(edges.begin(), edges.end(), [](const pair <uint64_t, uint64_t> &a, const pair <uint64_t, uint64_t> &b) {
+		return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+	});
+	for (const pair <uint64_t, uint64_t> &edge : edges) {
+		const uint32_t from = (uint32_t)edge.second;
+		const uint32_t to = (edge.second >> 32) ? blocks[from].taken : blocks[from].next;
+		if ((tail[head[from]] != from) || (head[to] != to) || (head[from] == to)) {
+			continue;
+		}
+		link[from] = to;
+		tail[head[from]] = tail[to];
+		for (uint32_t b = to; b != code_block::no_block; b = link[b]) {
+			head[b] = head[from];
+		}
+	}
+
+	vector <uint64_t> heat(size, 0);
+	vector <uint64_t> function_heat(size, 0);
+	for (uint32_t b = 0; b < size; b++) {
+		heat[head[b]] = max(heat[head[b]], blocks[b].count);
+		function_heat[blocks[b].function] = max(function_heat[blocks[b].function], blocks[b].count);
+	}
+
+	vector <uint32_t> chains;
+	for (uint32_t b = 0; b < size; b++) {
+		if (head[b] == b) {
+			chains.push_back(b);
+		}
+	}
+	stable_sort(chains.begin(), chains.end(), [&](uint32_t a, uint32_t b) {
+		const uint32_t fa = blocks[a].function, fb = blocks[b].function;
+		if (fa != fb) {
+			if ((fa == 0) || (fb == 0)) {
+				return fa == 0;
+			}
+			return (function_heat[fa] != function_heat[fb]) ? (function_heat[fa] > function_heat[fb]) : (fa < fb);
+		}
+		if (blocks[a].entry || blocks[b].entry) {
+			return blocks[a].entry;
+		}
+		return heat[a] > heat[b];
+	});
+
+	placement.clear();
+	for (uint32_t chain : chains) {
+		for (uint32_t b = chain; b != code_block::no_block; b = link[b]) {
+			placement.push_back(b);
 		}
-	} else if ((non_numeric_part.compare("a") == 0) && (numeric_part < 8)){
-		return (10 + numeric_part) << offset;
-	} else if ((non_numeric_part.compare("ra") == 0) && (input.size() == 2)) {
-		return (1) << offset;
-	} else if ((non_numeric_part.compare("sp") == 0) && (input.size() == 2)) {
-		return (2) << offset;
-	} else if ((non_numeric_part.compare("gp") == 0) && (input.size() == 2)) {
-		return (3) << offset;
-	} else if ((non_numeric_part.compare("tp") == 0) && (input.size() == 2)) {
-		return (4) << offset;
-	} else if ((non_numeric_part.compare("fp") == 0) && (input.size() == 2)) {
-		return (8) << offset;
-	} else if ((non_numeric_part.compare("zero") == 0) && (input.size() == 4)) {
-		return (0) << offset;
 	}
-	
-	cerr << "ERROR: invalid input in register name \""<< input <<"\"\n";
-	abort();
-	
-	return 0;
 }
 
 /**
- * \brief \c getOpcode() compares a string with an instruction list to determine what type it is and the base opcode. 
- * 
- * \param [in] input is the instruction to be compared.
- * \param [out] instruction_type is the RISC-V instruction type.
- * \returns The base opcode for an instruction.
- * 
- * \details This function will error out if an unknown opcode is entered.
- * \note This is the function that needs to be edited to add more instructions.
- */
-uint32_t risc_v_assembler::getOpcode(string input, char &instruction_type) {
-	instruction_type = 0;
-	if (input.compare("lb") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000000000000000011;
-	} else if (input.compare("lh") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000001000000000011;
-	} else if (input.compare("lw") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000010000000000011;
-	} else if (input.compare("ld") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000011000000000011;
-	} else if (input.compare("lbu") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000100000000000011;
-	} else if (input.compare("lhu") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000101000000000011;
-	} else if (input.compare("lwu") == 0) {
-		instruction_type = 'L';
-		return 0b00000000000000000110000000000011;
-	} else if (input.compare("addi") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000000000000010011;
-	} else if (input.compare("slli") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000001000000010011;
-	} else if (input.compare("slti") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000010000000010011;
-	} else if (input.compare("sltiu") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000011000000010011;
-	} else if (input.compare("xori") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000100000000010011;
-	} else if (input.compare("srli") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000101000000010011;
-	} else if (input.compare("srai") == 0) {
-		instruction_type = 'I';
-		return 0b01000000000000000101000000010011;
-	} else if (input.compare("ori") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000110000000010011;
-	} else if (input.compare("andi") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000111000000010011;
-	} else if (input.compare("auipc") == 0) {
-		instruction_type = 'U';
-		return 0b00000000000000000000000000010111;
-	} else if (input.compare("addiw") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000000000000011011;
-	} else if (input.compare("slliw") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000001000000011011;
-	} else if (input.compare("srliw") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000101000000011011;
-	} else if (input.compare("sraiw") == 0) {
-		instruction_type = 'I';
-		return 0b01000000000000000101000000011011;
-	} else if (input.compare("sb") == 0) {
-		instruction_type = 'S';
-		return 0b00000000000000000000000000100011;
-	} else if (input.compare("sh") == 0) {
-		instruction_type = 'S';
-		return 0b00000000000000000001000000100011;
-	} else if (input.compare("sw") == 0) {
-		instruction_type = 'S';
-		return 0b00000000000000000010000000100011;
-	} else if (input.compare("sd") == 0) {
-		instruction_type = 'S';
-		return 0b00000000000000000011000000100011;
-	} else if (input.compare("add") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000000000000110011;
-	} else if (input.compare("sub") == 0) {
-		instruction_type = 'R';
-		return 0b01000000000000000000000000110011;
-	} else if (input.compare("sll") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000001000000110011;
-	} else if (input.compare("slt") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000010000000110011;
-	} else if (input.compare("sltu") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000011000000110011;
-	} else if (input.compare("xor") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000100000000110011;
-	} else if (input.compare("srl") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000101000000110011;
-	} else if (input.compare("sra") == 0) {
-		instruction_type = 'R';
-		return 0b01000000000000000101000000110011;
-	} else if (input.compare("or") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000110000000110011;
-	} else if (input.compare("and") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000111000000110011;
-	} else if (input.compare("mul") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000000000000110011;
-	} else if (input.compare("mulh") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000010000000110011;
-	} else if (input.compare("mulhsu") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000010000000110011;
-	} else if (input.compare("mulhu") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000011000000110011;
-	} else if (input.compare("div") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000100000000110011;
-	} else if (input.compare("divu") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000101000000110011;
-	} else if (input.compare("rem") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000110000000110011;
-	} else if (input.compare("remu") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000111000000110011;
-	} else if (input.compare("lui") == 0) {
-		instruction_type = 'U';
-		return 0b00000000000000000000000000110111;
-	} else if (input.compare("addw") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000000000000111011;
-	} else if (input.compare("subw") == 0) {
-		instruction_type = 'R';
-		return 0b01000000000000000000000000111011;
-	} else if (input.compare("sllw") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000001000000111011;
-	} else if (input.compare("srlw") == 0) {
-		instruction_type = 'R';
-		return 0b00000000000000000101000000111011;
-	} else if (input.compare("sraw") == 0) {
-		instruction_type = 'R';
-		return 0b01000000000000000101000000111011;
-	} else if (input.compare("mulw") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000000000000111011;
-	} else if (input.compare("divw") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000100000000111011;
-	} else if (input.compare("divuw") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000101000000111011;
-	} else if (input.compare("remw") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000110000000111011;
-	} else if (input.compare("remuw") == 0) {
-		instruction_type = 'R';
-		return 0b00000010000000000111000000111011;
-	} else if (input.compare("beq") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000000000001100011;
-	} else if (input.compare("bne") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000001000001100011;
-	} else if (input.compare("blt") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000100000001100011;
-	} else if (input.compare("bge") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000101000001100011;
-	} else if (input.compare("bltu") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000110000001100011;
-	} else if (input.compare("bgeu") == 0) {
-		instruction_type = 'B';
-		return 0b00000000000000000111000001100011;
-	} else if (input.compare("jalr") == 0) {
-		instruction_type = 'I';
-		return 0b00000000000000000000000001100111;
-	} else if (input.compare("jal") == 0) {
-		instruction_type = 'J';
-		return 0b00000000000000000000000001101111;
-	} 
-	
-	cerr << "ERROR: unrecognized command \"" << input << "\"\n";
-	abort();
-	
-	return 0;
+ * \brief \c layoutBlocks() reorders the blocks and functions of each code section,
+ * from the execution count profile when \c OPTIMIZE_PROFILE_LAYOUT is set and otherwise from \c estimateCounts() when \c OPTIMIZE_STATIC_LAYOUT is,
+ * and moves the cold blocks to \c .text.cold when \c OPTIMIZE_SPLIT_COLD is set.
+ *
+ * \details The counts are turned into an order by \c chainBlocks(), the blocks \c markCold() picks are moved to the end of it, keeping their order,
+ * and the blocks are placed by \c placeBlocks(). Without either layout the hot blocks keep their original order.
+ * \c .text.cold is added after the sections already used the first time a block is moved there, and is not split itself.
+ * Branches between the hot and cold code are relaxed by \c layoutProgram() if they are out of reach, as any branch with a label may be,
+ * but a \c jal \c x0 can not be, so the hot and cold code must be within its 1 MiB reach of each other.
+ * Sections whose blocks can not be moved are left as they are.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::layoutBlocks() {
+	const bool profiled = (optimizations & OPTIMIZE_PROFILE_LAYOUT) != 0;
+	const bool reorder = (optimizations & (OPTIMIZE_PROFILE_LAYOUT | OPTIMIZE_STATIC_LAYOUT)) != 0;
+	const bool split = (optimizations & OPTIMIZE_SPLIT_COLD) != 0;
+	const uint32_t used = (uint32_t)sections.size();
+	const uint32_t selected = current_section;
+	vector <vector <uint64_t>> sequences(used);
+	vector <uint64_t> order;
+	vector <code_block> blocks;
+	vector <uint32_t> placement;
+
+	if (profiled && !profile_addresses.empty()) {
+		layoutProgram();
+	}
+	for (const pair <const string, uint64_t> &entry : profile_labels) {
+		if (profiled && (labels.find(entry.first) == labels.end())) {
+			cerr << "WARNING: the profile names label \"" << entry.first << "\", which is not in the program.\n";
+		}
+	}
+	for (const parsed_instruction &item : program) {
+		sequences[item.section].push_back(item.pos);
+	}
+
+	for (uint32_t section = 0; section < used; section++) {
+		bool movable = false;
+		if (sections[section].code && !sequences[section].empty()) {
+			movable = findBlocks(section, blocks);
+			if (!movable) {
+				cout << "left " << sections[section].name << " as it is, it has an auipc or a branch to a number\n";
+			}
+		}
+		if (!movable || (blocks.size() < 2)) {
+			order.insert(order.end(), sequences[section].begin(), sequences[section].end());
+			continue;
+		}
+
+		if (profiled) {
+			profileCounts(blocks);
+		} else if (reorder) {
+			estimateCounts(blocks);
+		}
+		const uint32_t cold = (split && (sections[section].name.compare(".text.cold") != 0)) ? markCold(blocks) : 0;
+		if (!reorder && (cold == 0)) {
+			order.insert(order.end(), sequences[section].begin(), sequences[section].end());
+			continue;
+		}
+
+		if (reorder) {
+			chainBlocks(blocks, placement);
+		} else {
+			placement.resize(blocks.size());
+			for (uint32_t b = 0; b < blocks.size(); b++) {
+				placement[b] = b;
+			}
+		}
+		stable_partition(placement.begin(), placement.end(), [&](uint32_t b) { return !blocks[b].cold; });
+
+		uint32_t cold_section = section;
+		if (cold != 0) {
+			selectSection(".text.cold");
+			cold_section = current_section;
+			current_section = selected;
+		}
+		placeBlocks(blocks, placement, (uint32_t)(blocks.size() - cold), cold_section, order);
+		if (cold != 0) {
+			cout << "moved " << cold << " cold blocks of " << sections[section].name << " to .text.cold\n";
+		}
+	}
+	rebuildProgram(order);
 }
 
 /**
- * \brief \c makeLabel() adds a label to branch/jump to. 
- * 
- * \param [in] name is the name of the branch.
- * \param [in] pos is the position.
+ * \brief \c fitsShortForm() tells if the label offset of an instruction that may be relaxed fits its single instruction form.
  */
-void risc_v_assembler::makeLabel(string name, uint64_t pos) {
-	labels[name] = pos;
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::fitsShortForm(const parsed_instruction &instruction) {
+	switch (isa_table[instruction.op].format) {
+		case 'B':
+			return fitsImmediate(instruction.imm, signedMin(format_layout<'B'>::imm_bits), signedMax(format_layout<'B'>::imm_bits), 2);
+		case 'J':
+			return fitsImmediate(instruction.imm, signedMin(format_layout<'J'>::imm_bits), signedMax(format_layout<'J'>::imm_bits), 2);
+		default:
+			return true;
+	}
 }
 
-
-
 /**
- * \brief \c findLabelPos() gets the location of the label that was branched/jumped to. 
- * 
- * \param [in] name is the name of the branch.
- * \returns The location of the label.
- * 
- * \details This function will error out if an unknown label is entered.
+ * \brief \c expandRelaxed() gives the real instructions a laid out instruction is written as.
+ *
+ * \param [in] instruction is the instruction, with its label resolved into \c imm.
+ * \param [out] parts receives the instructions, with their immediates resolved.
+ * \returns The number of instructions, 2 if the instruction was relaxed and 1 if not.
+ *
+ * \details A relaxed branch becomes the branch with the opposite condition, skipping over a \c jal to the label.
+ * The opposite condition is the other value of the lowest \c funct3 bit, which is how \c beq/\c bne, \c blt/\c bge and \c bltu/\c bgeu are paired.
+ * A relaxed \c jal becomes \c auipc of the upper bits of the offset, rounded for the sign extended low 12 bits, and \c jalr of the low 12 bits.
+ * The \c auipc writes \c rd, or \c t1 for a \c tail whose \c rd is \c x0.
  */
-uint64_t risc_v_assembler::findLabelPos(string name) {
-	map<string, uint64_t>::iterator it = labels.find(name);
-	if (it == labels.end()) {
-		cerr << "ERROR: undefined label \"" << name << "\"\n";
-		abort();
+template <unsigned XLEN>
+uint32_t risc_v_assembler<XLEN>::expandRelaxed(const parsed_instruction &instruction, parsed_instruction * parts) {
+	parts[0] = instruction;
+	if (instruction.size != 8) {
+		return 1;
 	}
-	return labels[name];
+
+	parts[1] = instruction;
+	if (isa_table[instruction.op].format == 'J') {
+		const uint32_t scratch = (instruction.rd != 0) ? instruction.rd : 6;
+		parts[0].op = isaId("auipc");
+		parts[0].rd = scratch;
+		parts[0].imm = (instruction.imm + 0x800) >> 12;
+		parts[1].op = isaId("jalr");
+		parts[1].rs1 = scratch;
+		parts[1].imm = signExtend(instruction.imm, 12);
+		return 2;
+	}
+
+	parts[0].op = (uint32_t)instruction_decoder.decode(isa_table[instruction.op].match ^ 0x00001000);
+	parts[0].imm = 8;
+	parts[1].op = isaId("jal");
+	parts[1].rd = 0;
+	parts[1].rs1 = 0;
+	parts[1].rs2 = 0;
+	parts[1].imm = instruction.imm - 4;
+	return 2;
 }
 
 /**
- * \brief \c processLine() assembles the machine code for one line. 
- * 
- * \param [in] input is the line from the file.
- * \param [in] pos is the instruction number.
- * \returns The instruction in HEX.
- * 
- * \details This function will error out if there are any issues.
- * \note This is the function that needs to be edited to add more instruction types.
+ * \brief \c layoutProgram() gives every item its size and byte address, and resolves label operands into byte offsets.
+ *
+ * \details Every instruction that may be compressed starts out at 2 bytes, assuming its label is in range.
+ * Each section is then laid out with its own location counter, alignment padding being worked out from the counter,
+ * and the sections are placed one after another from address 0, each rounded up to its alignment.
+ * Any instruction whose offset no longer fits its compressed form grows to 4 bytes, and any branch whose offset no longer fits
+ * its B-type immediate is relaxed to 8 bytes, which moves the items after it, so this repeats until nothing changes.
+ * Instructions only ever grow, and each at most twice, so this always finishes.
+ * Each pass is linear in the size of the program and in practice it takes two or three, even on very large programs,
+ * because only the instructions an earlier growth pushed out of range grow in the next pass.
+ * Data values that name a label are given the label's address once the layout is final.
  */
-uint32_t risc_v_assembler::processLine(string input, uint64_t pos) {
-	stringstream ss_input(input);
-	string temp;
-	ss_input >> temp;
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::layoutProgram() {
+	uint16_t compressed = 0;
+	vector <uint64_t> counters(sections.size());
 
-	char instruction_type;
-	
-	if ((temp.size() == 0 ) || (temp.at(0) == '#')) { // fix me
-		return 0;
-	}
-	
-	if (temp.at(temp.size() - 1) == ':') {
-		ss_input >> temp;
-	}
-	
-	if (!ss_input) {
-		return 0;
+	for (parsed_instruction &instruction : program) {
+		if (instruction.kind != ITEM_INSTRUCTION) {
+			continue;
+		}
+		if (instruction.label.size() != 0) {
+			instruction.imm = 0;
+		}
+		instruction.size = (instruction.compress && compressInstruction(instruction, compressed)) ? 2 : 4;
 	}
-	
-	if (temp.at(0) == '#') {
-		return 0;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		fill(counters.begin(), counters.end(), 0);
+		for (parsed_instruction &item : program) {
+			uint64_t &counter = counters[item.section];
+			if (item.kind == ITEM_ALIGN) {
+				item.size = (0 - counter) & (item.imm - 1);
+				if (item.size > item.limit) {
+					item.size = 0;
+				}
+			}
+			item.address = counter;
+			counter += item.size;
+		}
+
+		uint64_t address = 0;
+		for (uint32_t i = 0; i < sections.size(); i++) {
+			address = (address + sections[i].alignment - 1) & ~(sections[i].alignment - 1);
+			sections[i].base = address;
+			sections[i].size = counters[i];
+			address += counters[i];
+		}
+		program_size = address;
+
+		for (parsed_instruction &item : program) {
+			item.address += sections[item.section].base;
+		}
+
+		for (parsed_instruction &instruction : program) {
+			if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.label.size() == 0)) {
+				continue;
+			}
+			const uint64_t target = (instruction.target < program.size()) ? program[instruction.target].address : program_size;
+			instruction.imm = (int64_t)(target - instruction.address);
+			if ((instruction.size == 2) && !compressInstruction(instruction, compressed)) {
+				instruction.size = 4;
+				changed = true;
+			}
+			if ((instruction.size == 4) && instruction.relax && !fitsShortForm(instruction)) {
+				instruction.size = 8;
+				changed = true;
+			}
+		}
 	}
-	
-	uint32_t instruction = getOpcode(temp, instruction_type);
-	
-	ss_input >> temp;
-	
-	if (!(ss_input && (temp.at(0) != '#'))) {
-		cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-		abort();
+
+	for (parsed_instruction &data : program) {
+		if ((data.kind == ITEM_DATA) && (data.label.size() != 0)) {
+			data.imm = (int64_t)program[data.target].address;
+		}
 	}
-	string temp_2 = "";
-	char temp_c = 0;
-	
-	switch (instruction_type) {
-		case 'I':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 7);
-			
-			ss_input >> temp;
-			
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			if ((temp.size() >= 2) && (temp.at(0) == '0') && (temp.at(1) == 'x')) {
-				instruction |= ((stoi(temp, nullptr, 16)) << 20);
-			} else if ((temp.at(0) <= '9') && (temp.at(0) >= '0') || (temp.at(0) == '-')) {
-				instruction |= ((stoi(temp, nullptr)) << 20);
+}
+
+/**
+ * \brief \c writeItem() writes the contents of one item to the output file.
+ *
+ * \param [in] fout is the output file.
+ * \param [in] item is the item, already laid out.
+ * \param [in] machine_code is the encoding of the item if it is a full size instruction, two words if it was relaxed.
+ *
+ * \details Each line is one little endian value, and its number of hex digits gives its size:
+ * 8 for an instruction or \c .word, 4 for a compressed instruction or \c .half, 16 for a \c .dword and 2 for a byte.
+ * Alignment padding in a code section is made of \c nop, with a \c c.nop first if it starts 2 bytes past a multiple of 4.
+ * Only compressed code can leave it there, so \c c.nop is used whether or not the code after the padding may be compressed,
+ * and the padding never puts zero bytes where the code runs through it.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::writeItem(FILE * fout, const parsed_instruction &item, const uint32_t * machine_code) {
+	uint16_t compressed = 0;
+
+	switch (item.kind) {
+		case ITEM_INSTRUCTION:
+			if (item.size == 2) {
+				compressInstruction(item, compressed);
+				fprintf(fout, "%.4X\n", compressed);
 			} else {
-				instruction |= (((findLabelPos(temp) - pos)) << 20);
+				for (uint64_t i = 0; i < item.size / 4; i++) {
+					fprintf(fout, "%.8X\n", machine_code[i]);
+				}
 			}
 		break;
-		case 'L':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 7);
-			
-			ss_input.get();
-			temp_c = ss_input.get();
-			while (temp_c != '(' && ss_input) {
-				temp_2 += temp_c;
-				temp_c = ss_input.get();
-			}
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			
-			ss_input >> temp;
-			
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			if ((temp_2.size() >= 2) && (temp_2.at(0) == '0') && (temp_2.at(1) == 'x')) {
-				instruction |= ((stoi(temp_2, nullptr, 16)) << 20);
-			} else if ((temp_2.at(0) <= '9') && (temp_2.at(0) >= '0') || (temp_2.at(0) == '-')) {
-				instruction |= ((stoi(temp_2, nullptr)) << 20);
-			} else {
-				instruction |= (((findLabelPos(temp_2) - pos)) << 20);
-			}
+		case ITEM_DATA:
+			fprintf(fout, "%.*llX\n", (int)(2 * item.size), (unsigned long long)((uint64_t)item.imm & ((item.size < 8) ? fieldMask(8 * item.size) : UINT64_MAX)));
 		break;
-		case 'S':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 20);
-			
-			ss_input.get();
-			temp_c = ss_input.get();
-			while (temp_c != '(' && ss_input) {
-				temp_2 += temp_c;
-				temp_c = ss_input.get();
-			}
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			
-			ss_input >> temp;
-			
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			if ((temp_2.size() >= 2) && (temp_2.at(0) == '0') && (temp_2.at(1) == 'x')) {
-				instruction |= ((stoi(temp_2, nullptr, 16) &  0b11111) << 7 ) | 
-							   ((stoi(temp_2, nullptr, 16) & ~0b11111) << 20);
-			} else if ((temp_2.at(0) <= '9') && (temp_2.at(0) >= '0') || (temp_2.at(0) == '-')) {
-				instruction |= ((stoi(temp_2, nullptr) &  0b11111) << 7 ) | 
-							   ((stoi(temp_2, nullptr) & ~0b11111) << 20);
-			} else {
-				instruction |= (((findLabelPos(temp_2) - pos) &  0b11111) << 7 ) | 
-							   (((findLabelPos(temp_2) - pos) & ~0b11111) << 20);
+		case ITEM_STRING:
+			for (char c : item.bytes) {
+				fprintf(fout, "%.2X\n", (uint8_t)c);
 			}
 		break;
-		case 'U':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 7);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			if ((temp.size() >= 2) && (temp.at(0) == '0') && (temp.at(1) == 'x')) {
-				instruction |= ((stoi(temp, nullptr, 16)) << 12);
-			} else if ((temp.at(0) <= '9') && (temp.at(0) >= '0') || (temp.at(0) == '-')) {
-				instruction |= ((stoi(temp, nullptr)) << 12);
-			} else {
-				instruction |= (((findLabelPos(temp) - pos)) << 12);
+		case ITEM_FILL:
+			for (uint64_t i = 0; i < item.size; i++) {
+				fprintf(fout, "%.2X\n", (uint8_t)item.fill);
 			}
 		break;
-		case 'R':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 7);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			instruction |= getRegister(temp, 20);
-		break;
-		case 'J':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			if ((temp.size() >= 2) && (temp.at(0) == '0') && (temp.at(1) == 'x')) {
-				instruction |= (((stoi(temp, nullptr, 16) >> 20) & 0x1  ) << 31) | 
-							   (((stoi(temp, nullptr, 16) >> 1 ) & 0x3ff) << 21) | 
-							   (((stoi(temp, nullptr, 16) >> 11) & 0x1  ) << 20) | 
-							   (((stoi(temp, nullptr, 16) >> 12) & 0xff ) << 12);
-			} else if ((temp.at(0) <= '9') && (temp.at(0) >= '0') || (temp.at(0) == '-')) {
-				instruction |= (((stoi(temp, nullptr) >> 20) & 0x1  ) << 31) | 
-							   (((stoi(temp, nullptr) >> 1 ) & 0x3ff) << 21) | 
-							   (((stoi(temp, nullptr) >> 11) & 0x1  ) << 20) | 
-							   (((stoi(temp, nullptr) >> 12) & 0xff ) << 12);
-			} else {
-				instruction |= ((((findLabelPos(temp) - pos) >> 20) & 0x1  ) << 31) | 
-							   ((((findLabelPos(temp) - pos) >> 1 ) & 0x3ff) << 21) | 
-							   ((((findLabelPos(temp) - pos) >> 11) & 0x1  ) << 20) | 
-							   ((((findLabelPos(temp) - pos) >> 12) & 0xff ) << 12);
+		case ITEM_ALIGN:
+			for (uint64_t address = item.address; address < item.address + item.size;) {
+				const uint64_t left = item.address + item.size - address;
+				if ((item.fill < 0) && sections[item.section].code && ((address & 3) == 0) && (left >= 4)) {
+					fprintf(fout, "%.8X\n", isa_encoder.match[isaId("addi")]);
+					address += 4;
+				} else if ((item.fill < 0) && sections[item.section].code && ((address & 1) == 0) && (left >= 2)) {
+					fprintf(fout, "%.4X\n", 0x0001);
+					address += 2;
+				} else {
+					fprintf(fout, "%.2X\n", (item.fill < 0) ? 0 : (uint8_t)item.fill);
+					address += 1;
+				}
 			}
 		break;
-		case 'B':
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 15);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			instruction |= getRegister(temp.substr(0, (temp.size() - 1)), 20);
-			
-			ss_input >> temp;
-			if (!(ss_input && (temp.at(0) != '#'))) {
-				cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-				abort();
-			}
-			if ((temp.size() >= 2) && (temp.at(0) == '0') && (temp.at(1) == 'x')) {
-				instruction |= (((stoi(temp, nullptr, 16) >> 11) & 0x1 ) << 7 ) | 
-							   (((stoi(temp, nullptr, 16) >> 1 ) & 0xf ) << 8 ) | 
-							   (((stoi(temp, nullptr, 16) >> 5 ) & 0x3f) << 25) | 
-							   (((stoi(temp, nullptr, 16) >> 12) & 0x1 ) << 31);
-			} else if ((temp.at(0) <= '9') && (temp.at(0) >= '0') || (temp.at(0) == '-')) {
-				instruction |= (((stoi(temp, nullptr) >> 11) & 0x1 ) << 7 ) | 
-							   (((stoi(temp, nullptr) >> 1 ) & 0xf ) << 8 ) | 
-							   (((stoi(temp, nullptr) >> 5 ) & 0x3f) << 25) | 
-							   (((stoi(temp, nullptr) >> 12) & 0x1 ) << 31);
-			} else {
-				instruction |= ((((findLabelPos(temp) - pos) >> 11) & 0x1 ) << 7 ) | 
-							   ((((findLabelPos(temp) - pos) >> 1 ) & 0xf ) << 8 ) | 
-							   ((((findLabelPos(temp) - pos) >> 5 ) & 0x3f) << 25) | 
-							   ((((findLabelPos(temp) - pos) >> 12) & 0x1 ) << 31);
-			}
+		case ITEM_LABEL:
 		break;
-		default:
-			cerr << "ERROR: unknown type \'" << instruction_type << "\'\n";
-			abort();
-	}
-	
-	ss_input >> temp;
-	if (ss_input && (temp.at(0) != '#')) {
-		cerr << "ERROR: incorrect args at line \"" << pos << "\"\n";
-		abort();
 	}
-	
-	return instruction;
 }
 
 /**
- * \brief \c process() assembles the machine code line by line and exports to a file in hex NOT Executable. 
- * 
- * \details This function will error out if there are any issues.
+ * \brief \c process() assembles the machine code and exports to a file in hex NOT Executable.
+ *
+ * \details The file is read once with \c parseLine(), which collects the labels and instructions.
+ * Label operands are then resolved, the \c optimization_pass passes that were asked for are run, \c layoutProgram() picks the compressed instructions and gives every instruction its address,
+ * and the full size instructions are encoded together by \c encodeBatch().
+ * If there are any \c call or \c tail pseudo-instructions, the number that were shortened to a \c jal is reported.
+ * The sections are written in address order by \c writeItem(), one value per line.
+ * A section that does not start where the one before it ended is preceded by an \c @address line giving its byte address,
+ * so a program with only a \c .text section is written exactly as before, and \c .bss sections are left out.
+ * Lines with errors are skipped and recorded in \c diagnostics, which are all reported once the file has been read.
+ * If there were any errors the output file is removed rather than left with a partial program.
  * \note If you would like a binary executable, edit the fprintf statement.
  */
-void risc_v_assembler::process() {
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::process() {
 	fstream fin(input_file, fstream::in);
-	
+
 	if (!fin.is_open()) {
 		cerr << "ERROR: invalid input file.\n";
 		abort();
 	}
-	
+
 	FILE * fout;
 	fout = fopen(output_file, "w");
-	
+
 	if (fout == nullptr) {
 		cerr << "ERROR: invalid output file.\n";
 		abort();
 	}
-	
-	uint32_t instruction;
-	
+
+	diagnostics.clear();
+	labels.clear();
+	program.clear();
+	sections.clear();
+	selectSection(".text");
+	rvc_active = rvc;
+	extensions_active = extensions;
+
 	string input;
-	getline(fin, input);
-	stringstream ss_input(input);
-	string temp;
-	
-	for (int i = 1; fin; i++) {	
-		ss_input >> temp;
-		
-		if (!ss_input) {
-			if ((ss_input.str().size() != 0) && isspace(ss_input.str().at(0))) {
-				ss_input.clear();
-				continue;
-			} else {
-				ss_input.clear();
-				getline(fin, input);
-				ss_input.str(input);
-				continue;
-			}
+
+	for (current_line = 1; getline(fin, input); current_line++) {
+		cout << input << "\n";
+
+		current_column = 0;
+		try {
+			parseLine(input);
+		} catch (const assembly_error &e) {
+			diagnostics.push_back({current_line, current_column, e.what()});
 		}
-		
-		if ((temp.size() != 0) && (temp.at(temp.size() - 1) == ':')) {
-			makeLabel(temp.substr(0, (temp.size() - 1)), i);
-			ss_input >> temp;
-			if (!((temp.size() != 0) && ss_input) || ((temp.size() != 0) && (temp.at(0) == '#'))) {
-				i -= 1;
+	}
+	fin.close();
+
+	resolveLabels();
+	if (optimizations & OPTIMIZE_PEEPHOLE) {
+		peepholeProgram();
+	}
+	if (optimizations & (OPTIMIZE_PROFILE_LAYOUT | OPTIMIZE_STATIC_LAYOUT | OPTIMIZE_SPLIT_COLD)) {
+		layoutBlocks();
+	}
+	if (optimizations & OPTIMIZE_OUTLINE) {
+		outlineProgram();
+	}
+	if (optimizations & OPTIMIZE_SCHEDULE) {
+		scheduleProgram();
+	}
+	if (optimizations & OPTIMIZE_FUSION) {
+		fuseProgram();
+	}
+	if (optimizations & (OPTIMIZE_ALIGN_LOOPS | OPTIMIZE_ALIGN_TARGETS)) {
+		alignBranchTargets();
+	}
+	layoutProgram();
+
+	uint64_t calls = 0;
+	uint64_t shortened = 0;
+	for (const parsed_instruction &instruction : program) {
+		if ((instruction.kind == ITEM_INSTRUCTION) && instruction.relax && (isa_table[instruction.op].format == 'J')) {
+			calls++;
+			shortened += (instruction.size != 8);
+		}
+	}
+	if (calls != 0) {
+		cout << shortened << " of " << calls << " calls and tail calls shortened to jal\n";
+	}
+
+	operand_batch batch;
+	vector <uint64_t> batch_index(program.size());
+	parsed_instruction parts[2];
+	for (parsed_instruction &instruction : program) {
+		if ((instruction.kind != ITEM_INSTRUCTION) || (instruction.size == 2)) {
+			continue;
+		}
+		batch_index[instruction.pos] = batch.size();
+		const uint32_t count = expandRelaxed(instruction, parts);
+		for (uint32_t i = 0; i < count; i++) {
+			if (instruction.label.size() != 0) {
+				current_line = instruction.line;
+				current_column = instruction.column;
+				try {
+					checkFormatImmediate(parts[i]);
+				} catch (const assembly_error &e) {
+					diagnostics.push_back({current_line, current_column, e.what()});
+				}
 			}
+			batch.push(parts[i]);
 		}
-		
-		getline(fin, input);
-		ss_input.str(input);
 	}
-	
-	fin.clear();
-	fin.seekg(0, fin.beg);
-	
-	getline(fin, input);
-	ss_input.str(input);
-	
-	for (int i = 1; fin; i++) {
-		cout << input << "\n";
-		
-		instruction = processLine(input, i);
-		
-		if (instruction == 0) {
-			i -= 1;
-		} else {
-			fprintf(fout, "%.8X\n", instruction);
+
+	vector <uint32_t> machine_code(batch.size());
+	encodeBatch(batch, isa_encoder.match, isa_encoder.format, machine_code.data());
+
+	uint64_t written = 0;
+	for (uint32_t section = 0; section < sections.size(); section++) {
+		if (sections[section].nobits || (sections[section].size == 0)) {
+			continue;
+		}
+		if (sections[section].base != written) {
+			fprintf(fout, "@%.8llX\n", (unsigned long long)sections[section].base);
 		}
-		getline(fin, input);
+		for (const parsed_instruction &item : program) {
+			if (item.section == section) {
+				writeItem(fout, item, (item.kind == ITEM_INSTRUCTION) ? (machine_code.data() + batch_index[item.pos]) : nullptr);
+			}
+		}
+		written = sections[section].base + sections[section].size;
 	}
-	fin.close();
 	fclose(fout);
+
+	stable_sort(diagnostics.begin(), diagnostics.end(), [](const diagnostic &a, const diagnostic &b) { return a.line < b.line; });
+	for (const diagnostic &d : diagnostics) {
+		cerr << "ERROR: line " << d.line << ", column " << d.column << ": " << d.message << "\n";
+	}
+	if (diagnostics.size() != 0) {
+		cerr << diagnostics.size() << " error(s), no output written.\n";
+		remove(output_file);
+	}
 }
 
 /**
@@ -696,7 +5146,8 @@ void risc_v_assembler::process() {
  * 
  * \returns \c input_file
  */
-char * risc_v_assembler::getInputFile() {
+template <unsigned XLEN>
+char * risc_v_assembler<XLEN>::getInputFile() {
 	return input_file;
 }
 
@@ -705,7 +5156,8 @@ char * risc_v_assembler::getInputFile() {
  * 
  * \returns \c output_file
  */
-char * risc_v_assembler::getOutputFile() {
+template <unsigned XLEN>
+char * risc_v_assembler<XLEN>::getOutputFile() {
 	return output_file;
 }
 
@@ -714,7 +5166,8 @@ char * risc_v_assembler::getOutputFile() {
  * 
  * \param [in] input_file_name sets input_file.
  */
-void risc_v_assembler::setInputFile(char * input_file_name) {
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setInputFile(char * input_file_name) {
 	input_file = input_file_name;
 }
 
@@ -723,14 +5176,275 @@ void risc_v_assembler::setInputFile(char * input_file_name) {
  * 
  * \param [in] output_file_name sets output_file.
  */
-void risc_v_assembler::setOutputFile(char * output_file_name) {
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setOutputFile(char * output_file_name) {
 	output_file = output_file_name;
 }
 
+/**
+ * \brief \c getDiagnostics() returns the errors found by the last call to \c process(). 
+ * 
+ * \returns \c diagnostics
+ */
+template <unsigned XLEN>
+const vector <diagnostic> & risc_v_assembler<XLEN>::getDiagnostics() {
+	return diagnostics;
+}
+
+/**
+ * \brief \c getCompress() returns if instructions are compressed where they can be. 
+ * 
+ * \returns \c rvc
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::getCompress() {
+	return rvc;
+}
+
+/**
+ * \brief \c setCompress() sets if instructions are compressed where they can be, the same as \c .option \c rvc at the top of the file. 
+ * 
+ * \param [in] compress sets rvc.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setCompress(bool compress) {
+	rvc = compress;
+}
+
+/**
+ * \brief \c setExtension() sets if the target has an extension the assembler may use for pseudo-instructions, the same as \c .option \c arch at the top of the file.
+ * 
+ * \param [in] extension is the extension.
+ * \param [in] present sets if the target has it.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setExtension(optional_extension extension, bool present) {
+	if (present) {
+		extensions |= extension;
+	} else {
+		extensions &= ~(uint32_t)extension;
+	}
+}
+
+/**
+ * \brief \c setOptimization() sets if an optional pass is run over the program.
+ * 
+ * \param [in] pass is the pass.
+ * \param [in] run sets if it is run.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setOptimization(optimization_pass pass, bool run) {
+	if (run) {
+		optimizations |= pass;
+	} else {
+		optimizations &= ~(uint32_t)pass;
+	}
+}
+
+/**
+ * \brief \c setLatency() sets the number of cycles the scheduler expects an instruction to take to give its result.
+ * 
+ * \param [in] group is the \c latency_class of the instructions.
+ * \param [in] cycles is the latency, 1 if the next instruction may use the result without a stall.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setLatency(latency_class group, uint32_t cycles) {
+	latencies[group] = cycles;
+}
+
+/**
+ * \brief \c clearFusionPairs() empties the table of pairs the fusion pass brings together, so that it can be replaced.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::clearFusionPairs() {
+	fusion_pairs.clear();
+}
+
+/**
+ * \brief \c addFusionPair() adds a pair of instructions to the table the fusion pass brings together.
+ * 
+ * \param [in] first is the mnemonic of the instruction that comes first.
+ * \param [in] second is the mnemonic of the instruction that comes straight after it.
+ * \returns \c false if either mnemonic is not an instruction, and nothing was added.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::addFusionPair(const string &first, const string &second) {
+	const int32_t first_op = mnemonic_table<XLEN>.find(first);
+	const int32_t second_op = mnemonic_table<XLEN>.find(second);
+	if ((first_op < 0) || (second_op < 0)) {
+		return false;
+	}
+	fusion_pairs.push_back({(uint32_t)first_op, (uint32_t)second_op});
+	return true;
+}
+
+/**
+ * \brief \c setFetchBlock() sets the fetch block size that branch targets are aligned to, and the most padding that may be added for one.
+ * 
+ * \param [in] bytes is the fetch block size, a power of two.
+ * \param [in] limit is the padding budget of each branch target.
+ */
+template <unsigned XLEN>
+void risc_v_assembler<XLEN>::setFetchBlock(uint64_t bytes, uint64_t limit) {
+	fetch_block = bytes;
+	padding_limit = limit;
+}
+
+/**
+ * \brief \c loadProfile() reads an execution count profile for the profile guided block layout, and turns that pass on.
+ * 
+ * \param [in] file_name is the profile, one \c label \c count or \c address \c count per line, where an address starts with a digit.
+ * \returns \c false if the file could not be read, after reporting why.
+ *
+ * \details Blank lines and everything after a \c # are ignored, and counts for the same label or address are added together,
+ * so a trace may be given one line per instruction run.
+ */
+template <unsigned XLEN>
+bool risc_v_assembler<XLEN>::loadProfile(const char * file_name) {
+	fstream fin(file_name, fstream::in);
+	string line;
+
+	if (!fin.is_open()) {
+		cerr << "ERROR: invalid profile file.\n";
+		return false;
+	}
+	profile_labels.clear();
+	profile_addresses.clear();
+	for (uint64_t line_number = 1; getline(fin, line); line_number++) {
+		stringstream ss_line(line.substr(0, line.find('#')));
+		string key, count, extra;
+		if (!(ss_line >> key)) {
+			continue;
+		}
+		if (!(ss_line >> count) || (ss_line >> extra) || (count.find_first_not_of("0123456789") != string::npos)) {
+			cerr << "ERROR: profile line " << line_number << ": expected \"label count\" or \"address count\".\n";
+			return false;
+		}
+		size_t end = 0;
+		uint64_t address = 0, runs = 0;
+		try {
+			runs = stoull(count);
+			address = isdigit((unsigned char)key.at(0)) ? stoull(key, &end, 0) : 0;
+		} catch (const out_of_range &) {
+			cerr << "ERROR: profile line " << line_number << ": number too large.\n";
+			return false;
+		}
+		if (isdigit((unsigned char)key.at(0))) {
+			if (end != key.size()) {
+				cerr << "ERROR: profile line " << line_number << ": invalid address \"" << key << "\".\n";
+				return false;
+			}
+			profile_addresses[address] += runs;
+		} else {
+			profile_labels[key] += runs;
+		}
+	}
+	optimizations |= OPTIMIZE_PROFILE_LAYOUT;
+	return true;
+}
+
+/**
+ * \brief \c RISCV_XLEN selects the base ISA at build time, build with \c -DRISCV_XLEN=32 for an RV32I assembler.
+ */
+#ifndef RISCV_XLEN
+#define RISCV_XLEN 64
+#endif
 
 int main(int argc, char * argv[]) {
-	risc_v_assembler r1(argv[1], argv[2]);
+	risc_v_assembler<RISCV_XLEN> r1;
+	vector <char *> files;
+	
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if ((arg.compare("-c") == 0) || (arg.compare("--rvc") == 0)) {
+			r1.setCompress(true);
+		} else if (arg.compare("--zba") == 0) {
+			r1.setExtension(OPTIONAL_ZBA, true);
+		} else if (arg.compare("--zbb") == 0) {
+			r1.setExtension(OPTIONAL_ZBB, true);
+		} else if (arg.compare("--peephole") == 0) {
+			r1.setOptimization(OPTIMIZE_PEEPHOLE, true);
+		} else if (arg.compare("--schedule") == 0) {
+			r1.setOptimization(OPTIMIZE_SCHEDULE, true);
+		} else if (arg.compare("--fuse") == 0) {
+			r1.setOptimization(OPTIMIZE_FUSION, true);
+		} else if ((arg.compare("--fuse-pairs") == 0) && (i + 1 < argc)) {
+			stringstream pairs(argv[++i]);
+			string pair;
+			r1.setOptimization(OPTIMIZE_FUSION, true);
+			r1.clearFusionPairs();
+			while (getline(pairs, pair, ',')) {
+				const size_t plus = pair.find('+');
+				if ((plus == string::npos) || !r1.addFusionPair(pair.substr(0, plus), pair.substr(plus + 1))) {
+					cerr << "ERROR: invalid fusion pair \"" << pair << "\", expected first+second.\n";
+					return 2;
+				}
+			}
+		} else if ((arg.compare("--profile") == 0) && (i + 1 < argc)) {
+			if (!r1.loadProfile(argv[++i])) {
+				return 2;
+			}
+		} else if (arg.compare("--static-layout") == 0) {
+			r1.setOptimization(OPTIMIZE_STATIC_LAYOUT, true);
+		} else if (arg.compare("--split-cold") == 0) {
+			r1.setOptimization(OPTIMIZE_SPLIT_COLD, true);
+		} else if (arg.compare("--outline") == 0) {
+			r1.setOptimization(OPTIMIZE_OUTLINE, true);
+		} else if (arg.compare("--align-loops") == 0) {
+			r1.setOptimization(OPTIMIZE_ALIGN_LOOPS, true);
+		} else if (arg.compare("--align-targets") == 0) {
+			r1.setOptimization(OPTIMIZE_ALIGN_TARGETS, true);
+		} else if ((arg.compare("--fetch-block") == 0) && (i + 1 < argc)) {
+			const string setting = argv[++i];
+			const size_t comma = setting.find(',');
+			bool valid = (setting.find_first_not_of("0123456789,") == string::npos) && (setting.find(',', comma + 1) == string::npos)
+					&& (comma != 0) && (comma + 1 != setting.size());
+			uint64_t bytes = 0, limit = UINT64_MAX;
+			try {
+				bytes = valid ? stoull(setting.substr(0, comma)) : 0;
+				limit = (valid && (comma != string::npos)) ? stoull(setting.substr(comma + 1)) : UINT64_MAX;
+			} catch (const out_of_range &) {
+				valid = false;
+			}
+			if (!valid || (bytes < 2) || (bytes > 65536) || ((bytes & (bytes - 1)) != 0)) {
+				cerr << "ERROR: invalid fetch block \"" << setting << "\", expected a power of two from 2 to 65536 and an optional padding limit.\n";
+				return 2;
+			}
+			r1.setFetchBlock(bytes, limit);
+		} else if ((arg.compare("--latency") == 0) && (i + 1 < argc)) {
+			const string setting = argv[++i];
+			const size_t equals = setting.find('=');
+			uint32_t group = 0;
+			while ((group < LATENCY_CLASSES) && (setting.compare(0, equals, latency_names[group]) != 0)) {
+				group++;
+			}
+			bool valid = (group != LATENCY_CLASSES) && (equals != string::npos) && (setting.find_first_not_of("0123456789", equals + 1) == string::npos)
+					&& (equals + 1 != setting.size());
+			uint64_t cycles = 0;
+			try {
+				cycles = valid ? stoull(setting.substr(equals + 1)) : 0;
+			} catch (const out_of_range &) {
+				valid = false;
+			}
+			if (!valid || (cycles > UINT32_MAX)) {
+				cerr << "ERROR: invalid latency \"" << setting << "\", expected class=cycles with class one of alu, load, multiply, divide or float.\n";
+				return 2;
+			}
+			r1.setLatency((latency_class)group, (uint32_t)cycles);
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	
+	if (files.size() != 2) {
+		cerr << "usage: " << argv[0] << " [--rvc] [--zba] [--zbb] [--peephole] [--schedule] [--latency class=cycles] [--fuse] [--fuse-pairs first+second,...]\n"
+				<< "       [--align-loops] [--align-targets] [--fetch-block bytes[,limit]] [--profile file] [--static-layout] [--split-cold] [--outline]\n"
+				<< "       input_file output_file\n";
+		return 2;
+	}
+	r1.setInputFile(files[0]);
+	r1.setOutputFile(files[1]);
 	r1.process();
 	
-	return 0;
+	return r1.getDiagnostics().empty() ? 0 : 1;
 }
\ No newline at end of file